@@ -0,0 +1,42 @@
+/*
+ * Arduino.cpp
+ *
+ * Host versions of the Arduino core functions declared in Arduino.h, all
+ * backed by the simulated MCU in sim.h.
+ */
+
+#include "Arduino.h"
+#include "sim.h"
+
+volatile uint8_t MCUSR = _BV(PORF);
+
+// 32 bits, as on the MCU, so both roll over: millis() every 49.7 days and
+// micros() every 71.6 minutes
+unsigned long millis() {
+  return (uint32_t) sim::nowMillis();
+}
+
+unsigned long micros() {
+  return (uint32_t) sim::nowMicros();
+}
+
+void delay(unsigned long ms) {
+  sim::advance((uint64_t) ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::advance(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  sim::pinModeChanged(pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  sim::writePin(pin, level);
+}
+
+int digitalRead(uint8_t pin) {
+  return sim::readPin(pin);
+}
+
@@ -0,0 +1,90 @@
+/*
+ * Arduino.h
+ *
+ * Host (native) replacement for the parts of the Arduino core used by the
+ * controller. Time comes from the virtual clock in sim.h and pins are simulated
+ * in memory, so the firmware can be run and inspected on a PC.
+ */
+
+#ifndef _ARDUINO_H
+#define _ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <type_traits>
+
+#include "Print.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH          0x1
+#define LOW           0x0
+
+#define INPUT         0x0
+#define OUTPUT        0x1
+#define INPUT_PULLUP  0x2
+
+// Number of simulated digital pins, as on the Nano
+#define NUM_DIGITAL_PINS  20
+
+// Analog pins used as digital pins
+#define A0  14
+#define A1  15
+#define A2  16
+#define A3  17
+#define A4  18
+#define A5  19
+
+#define _BV(bit) (1 << (bit))
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr)   (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)   (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)  (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr)    (*(void * const *)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+// Return by value: decltype() of the conditional would be a reference to a
+// parameter when both have the same type
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type min(A a, B b) {
+  return a < b ? a : b;
+}
+
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type max(A a, B b) {
+  return a > b ? a : b;
+}
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+
+// There is no concurrency on the host: interrupt handlers are called directly
+// by the simulator between passes of loop()
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// MCU status register: flags giving cause of last reset. A harness may set it
+// before calling sim::begin(). Initially power-on reset.
+extern volatile uint8_t MCUSR;
+
+#define PORF  0
+#define EXTRF 1
+#define BORF  2
+#define WDRF  3
+
+void setup();
+void loop();
+
+#endif
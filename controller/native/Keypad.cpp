@@ -0,0 +1,16 @@
+/*
+ * Keypad.cpp
+ *
+ * Implementation of the host Keypad. See Keypad.h.
+ */
+
+#include "Keypad.h"
+#include "sim.h"
+
+Keypad::Keypad(char *userKeymap, byte *row, byte *col, byte numRows, byte numCols) {
+  sim::attachKeypad(userKeymap, row, col, numRows, numCols);
+}
+
+char Keypad::getKey() {
+  return sim::nextKey();
+}
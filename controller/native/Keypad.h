@@ -0,0 +1,34 @@
+/*
+ * Keypad.h
+ *
+ * Host (native) version of the Keypad library. Keys pressed with
+ * sim::pressKey() are returned by getKey() one at a time, so there is no
+ * scanning or debouncing and the keypad is always IDLE between keys. The
+ * simulator is told the keypad's layout, so a key only wakes the MCU if its
+ * column is driven LOW.
+ */
+
+#ifndef _KEYPAD_H
+#define _KEYPAD_H
+
+#include "Arduino.h"
+
+#define NO_KEY '\0'
+
+#define makeKeymap(x) ((char *) x)
+
+typedef enum { IDLE, PRESSED, HOLD, RELEASED } KeyState;
+
+class Keypad {
+
+  public:
+
+    Keypad(char *userKeymap, byte *row, byte *col, byte numRows, byte numCols);
+
+    char getKey();
+    KeyState getState() { return IDLE; }
+    void setDebounceTime(unsigned int debounce) { (void) debounce; }
+    void setHoldTime(unsigned int hold) { (void) hold; }
+};
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Print.cpp
+ *
+ * Host version of the Arduino core's Print class.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Print.h"
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    if (write(*buffer++)) {
+      n++;
+    }
+    else {
+      break;
+    }
+  }
+  return n;
+}
+
+size_t Print::write(const char *str) {
+  return str ? write((const uint8_t *) str, strlen(str)) : 0;
+}
+
+size_t Print::print(const __FlashStringHelper *s) {
+  return write(reinterpret_cast<const char *>(s));
+}
+
+size_t Print::print(const char s[]) {
+  return write(s);
+}
+
+size_t Print::print(char c) {
+  return write((uint8_t) c);
+}
+
+size_t Print::print(unsigned char n, int base) {
+  return print((unsigned long) n, base);
+}
+
+size_t Print::print(int n, int base) {
+  return print((long) n, base);
+}
+
+size_t Print::print(unsigned int n, int base) {
+  return print((unsigned long) n, base);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == DEC && n < 0) {
+    return print('-') + printNumber(-(unsigned long) n, DEC);
+  }
+  return printNumber((unsigned long) n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+  return write(buffer);
+}
+
+size_t Print::println(const __FlashStringHelper *s) {
+  return print(s) + println();
+}
+
+size_t Print::println(const char s[]) {
+  return print(s) + println();
+}
+
+size_t Print::println(char c) {
+  return print(c) + println();
+}
+
+size_t Print::println(unsigned char n, int base) {
+  return print(n, base) + println();
+}
+
+size_t Print::println(int n, int base) {
+  return print(n, base) + println();
+}
+
+size_t Print::println(unsigned int n, int base) {
+  return print(n, base) + println();
+}
+
+size_t Print::println(long n, int base) {
+  return print(n, base) + println();
+}
+
+size_t Print::println(unsigned long n, int base) {
+  return print(n, base) + println();
+}
+
+size_t Print::println(double n, int digits) {
+  return print(n, digits) + println();
+}
+
+size_t Print::println() {
+  return write("\r\n");
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+  char buffer[8 * sizeof(long) + 1];
+  char *p = &buffer[sizeof(buffer) - 1];
+  *p = '\0';
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    char digit = n % base;
+    n /= base;
+    *--p = digit < 10 ? digit + '0' : digit + 'A' - 10;
+  } while (n);
+  return write(p);
+}
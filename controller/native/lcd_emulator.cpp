@@ -0,0 +1,132 @@
+/*
+ * lcd_emulator.cpp
+ *
+ * Implementation of LcdEmulator. See lcd_emulator.h.
+ */
+
+#include <string.h>
+
+#include "lcd_emulator.h"
+
+#define EXPANDER_RS         0x01
+#define EXPANDER_ENABLE     0x04
+#define EXPANDER_BACKLIGHT  0x08
+
+// Start of each row in display data RAM in 2 line mode
+static const uint8_t ROW_ADDRESSES[LcdEmulator::HEIGHT] = {0x00, 0x40};
+
+LcdEmulator::LcdEmulator()
+  : _address(0), _fourBitMode(false), _haveHighNibble(false), _highNibble(0), _lastEnable(false),
+    _lastValue(0), _backlight(false), _displayOn(false), _increment(true), _clearCount(0),
+    _instructionCount(0), _characterCount(0), _timingViolationCount(0) {
+  memset(_ddram, ' ', sizeof(_ddram));
+}
+
+void LcdEmulator::expanderWrite(uint8_t value) {
+  bool enable = value & EXPANDER_ENABLE;
+  _backlight = value & EXPANDER_BACKLIGHT;
+  // RS & data must be set up before E rises & held until it falls, so mustn't
+  // change in the same write as E
+  if (enable != _lastEnable && ((value ^ _lastValue) & ~(EXPANDER_ENABLE | EXPANDER_BACKLIGHT))) {
+    _timingViolationCount++;
+  }
+  // HD44780 latches data on falling edge of E
+  if (_lastEnable && !enable) {
+    latch(_lastValue);
+  }
+  _lastEnable = enable;
+  _lastValue = value;
+}
+
+std::string LcdEmulator::line(uint8_t row) const {
+  return std::string(_ddram + ROW_ADDRESSES[row], WIDTH);
+}
+
+void LcdEmulator::latch(uint8_t value) {
+  uint8_t nibble = value >> 4;
+  if (!_fourBitMode) {
+    // In 8 bit mode D0..D3 aren't connected, so read as 0
+    instruction(nibble << 4);
+    return;
+  }
+  if (!_haveHighNibble) {
+    _highNibble = nibble;
+    _haveHighNibble = true;
+    return;
+  }
+  _haveHighNibble = false;
+  uint8_t b = (_highNibble << 4) | nibble;
+  if (value & EXPANDER_RS) {
+    data(b);
+  }
+  else {
+    instruction(b);
+  }
+}
+
+void LcdEmulator::instruction(uint8_t value) {
+  _instructionCount++;
+  if (value & 0x80) {
+    // Set DDRAM address
+    _address = value & 0x7F;
+    if (_address >= DDRAM_SIZE) {
+      _address = 0;
+    }
+  }
+  else if (value & 0x40) {
+    // Set CGRAM address: custom characters not emulated
+  }
+  else if (value & 0x20) {
+    // Function set
+    _fourBitMode = !(value & 0x10);
+  }
+  else if (value & 0x10) {
+    // Cursor or display shift: not emulated
+  }
+  else if (value & 0x08) {
+    _displayOn = value & 0x04;
+  }
+  else if (value & 0x04) {
+    _increment = value & 0x02;
+  }
+  else if (value & 0x02) {
+    _address = 0;
+  }
+  else if (value & 0x01) {
+    memset(_ddram, ' ', sizeof(_ddram));
+    _address = 0;
+    _clearCount++;
+  }
+}
+
+void LcdEmulator::data(uint8_t value) {
+  _characterCount++;
+  _ddram[_address] = value;
+  moveAddress();
+}
+
+// In 2 line mode addresses run 0x00..0x27 then 0x40..0x67 and wrap
+void LcdEmulator::moveAddress() {
+  if (_increment) {
+    if (_address == 0x27) {
+      _address = 0x40;
+    }
+    else if (_address == 0x67) {
+      _address = 0x00;
+    }
+    else {
+      _address++;
+    }
+  }
+  else {
+    if (_address == 0x00) {
+      _address = 0x67;
+    }
+    else if (_address == 0x40) {
+      _address = 0x27;
+    }
+    else {
+      _address--;
+    }
+  }
+}
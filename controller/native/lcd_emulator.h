@@ -0,0 +1,71 @@
+/*
+ * lcd_emulator.h
+ *
+ * Emulates a 16x2 HD44780 LCD behind a PCF8574 I2C port expander wired as on
+ * the common LCD backpack: P0 = RS, P1 = RW, P2 = E, P3 = backlight and
+ * P4..P7 = D4..D7. Decodes the bytes written to the expander, so the displayed
+ * text reflects exactly what the firmware sent over the bus.
+ */
+
+#ifndef _LCD_EMULATOR_H
+#define _LCD_EMULATOR_H
+
+#include <stdint.h>
+
+#include <string>
+
+class LcdEmulator {
+
+  public:
+
+    static const uint8_t WIDTH = 16;
+    static const uint8_t HEIGHT = 2;
+
+    LcdEmulator();
+
+    // Byte written to the port expander
+    void expanderWrite(uint8_t value);
+
+    // Text displayed on a row
+    std::string line(uint8_t row) const;
+
+    bool isBacklightOn() const { return _backlight; }
+    bool isDisplayOn() const { return _displayOn; }
+
+    // Number of clear display instructions received
+    unsigned long clearCount() const { return _clearCount; }
+
+    // Number of instructions & characters received
+    unsigned long instructionCount() const { return _instructionCount; }
+    unsigned long characterCount() const { return _characterCount; }
+
+    // Number of times RS or the data lines changed in the same expander write
+    // as E, so weren't set up before E rose or held until it fell
+    unsigned long timingViolationCount() const { return _timingViolationCount; }
+
+  private:
+
+    static const uint8_t DDRAM_SIZE = 0x68;
+
+    char _ddram[DDRAM_SIZE];
+    uint8_t _address;
+    bool _fourBitMode;
+    bool _haveHighNibble;
+    uint8_t _highNibble;
+    bool _lastEnable;
+    uint8_t _lastValue;
+    bool _backlight;
+    bool _displayOn;
+    bool _increment;
+    unsigned long _clearCount;
+    unsigned long _instructionCount;
+    unsigned long _characterCount;
+    unsigned long _timingViolationCount;
+
+    void latch(uint8_t value);
+    void instruction(uint8_t value);
+    void data(uint8_t value);
+    void moveAddress();
+};
+
+#endif
@@ -0,0 +1,408 @@
+/*
+ * sim.cpp
+ *
+ * Implementation of the simulated MCU. See sim.h.
+ */
+
+#include <stddef.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "Arduino.h"
+#include "reset_flags.h"
+#include "sim.h"
+
+namespace sim {
+
+  struct Pin {
+    uint8_t mode = INPUT;
+    uint8_t output = LOW;
+    // Level driven onto the pin from outside. Inputs are assumed to have
+    // pull-up resistors on the board.
+    uint8_t input = HIGH;
+    bool wake = false;
+  };
+
+  struct Timer {
+    unsigned long (*timeToNext)();
+    void (*advance)(unsigned long ms);
+  };
+
+  static const unsigned long TIMER_IDLE = 0xFFFFFFFFUL;
+
+  static uint64_t now = 0;
+  // runUntil() doesn't let loop() sleep beyond this time
+  static uint64_t horizon = UINT64_MAX;
+  static unsigned long loops = 0;
+  static unsigned long loopTime = 0;
+  static bool woken = false;
+
+  static Pin pins[NUM_DIGITAL_PINS];
+  static std::multimap<uint64_t, std::function<void()>> events;
+  static std::vector<Timer> timers;
+  static std::vector<std::function<void(uint8_t, uint8_t)>> pinListeners;
+  static std::vector<std::function<void()>> loopListeners;
+  struct KeyPress {
+    char key;
+    uint64_t pressedAt;
+  };
+
+  static std::deque<KeyPress> keys;
+  // Time the last key held down was released, so the next could be held
+  static uint64_t keyReleasedAt = 0;
+  static unsigned long ignoredKeys = 0;
+  static const char *keymap = NULL;
+  static const uint8_t *keypadRowPins = NULL;
+  static const uint8_t *keypadColPins = NULL;
+  static uint8_t keypadRows = 0;
+  static uint8_t keypadCols = 0;
+  static std::deque<char> serialIn;
+  static FILE *serialOut = stdout;
+  static unsigned int supplyMillivolts = 5000;
+
+  static LcdEmulator lcdEmulator;
+  static unsigned long transmissions = 0;
+  static unsigned long bytes = 0;
+  static uint32_t i2cClock = 100000;
+  static uint64_t i2cBusyUntil = 0;
+  static bool i2cConnected = true;
+
+  static uint8_t eepromBytes[EEPROM_SIZE];
+  static bool eepromErased = false;
+
+  static void runDueEvents() {
+    while (!events.empty() && events.begin()->first <= now) {
+      std::function<void()> action = events.begin()->second;
+      events.erase(events.begin());
+      action();
+    }
+  }
+
+  // Moves clock to target, stopping at each scheduled event & timer deadline
+  // on the way. Stops early if a wake pin changes & stopOnWake is true.
+  static void advanceTo(uint64_t target, bool stopOnWake) {
+    runDueEvents();
+    while (now < target) {
+      if (stopOnWake && woken) {
+        return;
+      }
+      uint64_t next = target;
+      if (!events.empty() && events.begin()->first < next) {
+        next = events.begin()->first;
+      }
+      for (const Timer &timer : timers) {
+        unsigned long ms = timer.timeToNext();
+        if (ms != TIMER_IDLE) {
+          uint64_t due = (now / 1000 + ms) * 1000;
+          if (due < next) {
+            next = due;
+          }
+        }
+      }
+      uint64_t crossed = next / 1000 - now / 1000;
+      now = next;
+      if (crossed > 0) {
+        for (const Timer &timer : timers) {
+          timer.advance(crossed);
+        }
+      }
+      runDueEvents();
+    }
+  }
+
+  uint64_t nowMicros() {
+    return now;
+  }
+
+  uint64_t nowMillis() {
+    return now / 1000;
+  }
+
+  void advance(uint64_t micros) {
+    advanceTo(now + micros, false);
+  }
+
+  void begin() {
+    saveResetFlags();
+    setup();
+  }
+
+  void runUntil(uint64_t ms) {
+    horizon = ms * 1000;
+    while (now < horizon) {
+      uint64_t before = now;
+      loop();
+      loops++;
+      for (auto &listener : loopListeners) {
+        listener();
+      }
+      if (loopTime > 0) {
+        advance(loopTime);
+      }
+      else if (now == before) {
+        // Make sure time moves on even if loop() never waits
+        advance(1);
+      }
+    }
+    horizon = UINT64_MAX;
+  }
+
+  void runFor(uint64_t ms) {
+    runUntil(nowMillis() + ms);
+  }
+
+  unsigned long loopCount() {
+    return loops;
+  }
+
+  void onLoop(std::function<void()> listener) {
+    loopListeners.push_back(listener);
+  }
+
+  void setLoopTime(unsigned long micros) {
+    loopTime = micros;
+  }
+
+  void setPin(uint8_t pin, uint8_t level) {
+    Pin &p = pins[pin];
+    if (p.input == level) {
+      return;
+    }
+    p.input = level;
+    if (p.wake) {
+      woken = true;
+    }
+  }
+
+  // Time the first key in the queue was, or will be, held down
+  static uint64_t keyHeldAt() {
+    return keys.front().pressedAt > keyReleasedAt ? keys.front().pressedAt : keyReleasedAt;
+  }
+
+  // Wakes the MCU if the key held down pulls its row LOW, as its column is
+  // driven LOW & the row is a wake pin
+  static void checkKeyWake() {
+    if (keys.empty() || keyHeldAt() > now) {
+      return;
+    }
+    for (uint8_t row = 0; row < keypadRows; row++) {
+      for (uint8_t col = 0; col < keypadCols; col++) {
+        if (keymap[row * keypadCols + col] != keys.front().key) {
+          continue;
+        }
+        const Pin &column = pins[keypadColPins[col]];
+        if (column.mode == OUTPUT && column.output == LOW && pins[keypadRowPins[row]].wake) {
+          woken = true;
+        }
+        return;
+      }
+    }
+  }
+
+  static void releaseExpiredKeys();
+
+  // Holds down the first key in the queue, if it's time to
+  static void holdNextKey() {
+    if (keys.empty()) {
+      return;
+    }
+    uint64_t heldAt = keyHeldAt();
+    events.insert(std::make_pair(heldAt + KEY_HOLD_TIME * 1000, releaseExpiredKeys));
+    if (heldAt <= now) {
+      checkKeyWake();
+    }
+    else {
+      events.insert(std::make_pair(heldAt, checkKeyWake));
+    }
+  }
+
+  // Releases keys held for KEY_HOLD_TIME without being read, which are lost
+  static void releaseExpiredKeys() {
+    while (!keys.empty() && keyHeldAt() + KEY_HOLD_TIME * 1000 <= now) {
+      keyReleasedAt = keyHeldAt() + KEY_HOLD_TIME * 1000;
+      keys.pop_front();
+      ignoredKeys++;
+      holdNextKey();
+    }
+  }
+
+  void pressKey(char key) {
+    keys.push_back(KeyPress{key, now});
+    if (keys.size() == 1) {
+      holdNextKey();
+    }
+  }
+
+  unsigned long ignoredKeyCount() {
+    return ignoredKeys;
+  }
+
+  void at(uint64_t ms, std::function<void()> action) {
+    events.insert(std::make_pair(ms * 1000, action));
+  }
+
+  void serialInput(const char *text) {
+    while (*text) {
+      serialIn.push_back(*text++);
+    }
+  }
+
+  void setSupplyVoltage(unsigned int mV) {
+    supplyMillivolts = mV;
+  }
+
+  unsigned int supplyVoltage() {
+    return supplyMillivolts;
+  }
+
+  uint8_t pinLevel(uint8_t pin) {
+    return pins[pin].output;
+  }
+
+  void onPinChange(std::function<void(uint8_t pin, uint8_t level)> listener) {
+    pinListeners.push_back(listener);
+  }
+
+  LcdEmulator &lcd() {
+    return lcdEmulator;
+  }
+
+  void setSerialOutput(FILE *stream) {
+    serialOut = stream;
+  }
+
+  unsigned long i2cTransmissions() {
+    return transmissions;
+  }
+
+  unsigned long i2cBytes() {
+    return bytes;
+  }
+
+  bool isI2CIdle() {
+    return now >= i2cBusyUntil;
+  }
+
+  uint8_t *eeprom() {
+    if (!eepromErased) {
+      memset(eepromBytes, 0xFF, EEPROM_SIZE);
+      eepromErased = true;
+    }
+    return eepromBytes;
+  }
+
+  void attachTimer(unsigned long (*timeToNext)(), void (*advance)(unsigned long ms)) {
+    timers.push_back(Timer{timeToNext, advance});
+  }
+
+  void enableWakePin(uint8_t pin) {
+    pins[pin].wake = true;
+  }
+
+  void attachKeypad(const char *map, const uint8_t *rowPins, const uint8_t *colPins, uint8_t rows, uint8_t cols) {
+    keymap = map;
+    keypadRowPins = rowPins;
+    keypadColPins = colPins;
+    keypadRows = rows;
+    keypadCols = cols;
+  }
+
+  bool sleep(unsigned long ms) {
+    if (woken) {
+      woken = false;
+      return true;
+    }
+    uint64_t target = now + (uint64_t) ms * 1000;
+    if (target > horizon) {
+      target = horizon;
+    }
+    advanceTo(target, true);
+    bool result = woken;
+    woken = false;
+    return result;
+  }
+
+  void pinModeChanged(uint8_t pin, uint8_t mode) {
+    pins[pin].mode = mode;
+    // Driving a column may pull a row LOW
+    checkKeyWake();
+  }
+
+  void writePin(uint8_t pin, uint8_t level) {
+    Pin &p = pins[pin];
+    level = level ? HIGH : LOW;
+    if (p.output == level) {
+      return;
+    }
+    p.output = level;
+    checkKeyWake();
+    for (auto &listener : pinListeners) {
+      listener(pin, level);
+    }
+  }
+
+  uint8_t readPin(uint8_t pin) {
+    const Pin &p = pins[pin];
+    return p.mode == OUTPUT ? p.output : p.input;
+  }
+
+  char nextKey() {
+    releaseExpiredKeys();
+    if (keys.empty() || keyHeldAt() > now) {
+      return 0;
+    }
+    char key = keys.front().key;
+    keys.pop_front();
+    keyReleasedAt = now;
+    holdNextKey();
+    return key;
+  }
+
+  int serialRead() {
+    if (serialIn.empty()) {
+      return -1;
+    }
+    char c = serialIn.front();
+    serialIn.pop_front();
+    return (unsigned char) c;
+  }
+
+  void serialWrite(const uint8_t *buffer, size_t size) {
+    if (serialOut) {
+      fwrite(buffer, 1, size, serialOut);
+    }
+  }
+
+  void interruptAfter(uint64_t micros, void (*isr)()) {
+    events.insert(std::make_pair(now + micros, std::function<void()>(isr)));
+  }
+
+  // The LCD is the only device on the bus, so it receives every transmission
+  bool i2cTransmitInBackground(uint8_t address, const uint8_t *data, size_t size, void (*done)()) {
+    (void) address;
+    if (!i2cConnected) {
+      return false;
+    }
+    transmissions++;
+    bytes += size;
+    for (size_t i = 0; i < size; i++) {
+      lcdEmulator.expanderWrite(data[i]);
+    }
+    // Data bytes of 8 bits plus ACK. Transmission is continued by done(), so
+    // there is no further address byte.
+    uint64_t duration = (uint64_t) size * 9 * 1000000 / i2cClock;
+    i2cBusyUntil = now + duration;
+    interruptAfter(duration, done);
+    return true;
+  }
+
+  void setI2CConnected(bool connected) {
+    i2cConnected = connected;
+  }
+
+  void setI2CClock(uint32_t frequency) {
+    i2cClock = frequency;
+  }
+}
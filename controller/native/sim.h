@@ -0,0 +1,149 @@
+/*
+ * sim.h
+ *
+ * Control of the simulated MCU used by the host (native) build.
+ *
+ * Time is kept by a virtual clock that only moves when the firmware waits
+ * (delay(), blocking I2C transfers, sleeping between events) or when a harness
+ * moves it on. Since the firmware sleeps until its next deadline, simulated
+ * time runs many thousands of times faster than real time.
+ *
+ * A harness calls begin() to run setup() and then runUntil() / runFor() to run
+ * loop() up to a given time. Inputs can be changed directly between runs or
+ * scheduled to happen at a given time, in which case they are applied part way
+ * through any wait and wake the firmware just as an interrupt would.
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <functional>
+
+#include "lcd_emulator.h"
+
+namespace sim {
+
+  // Clock
+
+  uint64_t nowMicros();
+  uint64_t nowMillis();
+
+  // Moves the clock forward, applying scheduled inputs and running timers
+  void advance(uint64_t micros);
+
+  // Running the firmware
+
+  // Resets the MCU, saving the reset flags from MCUSR, & calls setup()
+  void begin();
+
+  // Calls loop() repeatedly until the clock reaches the given time in ms
+  void runUntil(uint64_t ms);
+  void runFor(uint64_t ms);
+
+  // Number of times loop() has been called
+  unsigned long loopCount();
+
+  // Called after each pass of loop()
+  void onLoop(std::function<void()> listener);
+
+  // Time charged for each pass of loop() in microseconds. Default 0.
+  void setLoopTime(unsigned long micros);
+
+  // Inputs
+
+  // Drives an input pin, waking the MCU if the pin is a wake pin
+  void setPin(uint8_t pin, uint8_t level);
+
+  // Presses & releases a key on the keypad. Keys are held down one at a time,
+  // in the order pressed, until read by the firmware or for KEY_HOLD_TIME ms.
+  // A held key pulls its row LOW, waking the MCU, only while its column is
+  // driven LOW. A key that isn't read while held is lost.
+  static const unsigned long KEY_HOLD_TIME = 200;
+  void pressKey(char key);
+
+  // Schedules an action, usually an input change, for the given time in ms
+  void at(uint64_t ms, std::function<void()> action);
+
+  // Makes text available to be read from Serial
+  void serialInput(const char *text);
+
+  // Supply voltage in mV, as measured by the MCU. Default 5000.
+  void setSupplyVoltage(unsigned int mV);
+  unsigned int supplyVoltage();
+
+  // Outputs
+
+  // Level of an output pin as last written by the firmware
+  uint8_t pinLevel(uint8_t pin);
+
+  // Called whenever the firmware changes the level of an output pin
+  void onPinChange(std::function<void(uint8_t pin, uint8_t level)> listener);
+
+  // The LCD attached to the I2C bus
+  LcdEmulator &lcd();
+
+  // Where text written to Serial goes. NULL discards it. Default stdout.
+  void setSerialOutput(FILE *stream);
+
+  // Number of keys lost, as they weren't read while held down
+  unsigned long ignoredKeyCount();
+
+  // I2C bus traffic since start up
+  unsigned long i2cTransmissions();
+  unsigned long i2cBytes();
+
+  // True unless a transmission is still being sent
+  bool isI2CIdle();
+
+  // Connects or disconnects the LCD. While disconnected no transmission is
+  // acknowledged. Default connected.
+  void setI2CConnected(bool connected);
+
+  // Contents of the MCU's EEPROM, initially erased (all 0xFF)
+  static const size_t EEPROM_SIZE = 1024;
+  uint8_t *eeprom();
+
+  // Used by the mock Arduino layer
+
+  // Stands in for a hardware timer interrupt that is due timeToNext() ms from
+  // now. advance(n) is called with the number of ms boundaries crossed each
+  // time the clock moves, and the clock never moves past the next due time
+  // without calling it.
+  void attachTimer(unsigned long (*timeToNext)(), void (*advance)(unsigned long ms));
+
+  void enableWakePin(uint8_t pin);
+
+  // Layout of the keypad: the key at each row & column, row by row, and the
+  // pins of the rows & columns
+  void attachKeypad(const char *keymap, const uint8_t *rowPins, const uint8_t *colPins, uint8_t rows, uint8_t cols);
+
+  // Sleeps for up to the given time or until woken by a wake pin. Returns true
+  // if a wake pin has changed since the last call, without sleeping if it
+  // changed before this call.
+  bool sleep(unsigned long ms);
+
+  void pinModeChanged(uint8_t pin, uint8_t mode);
+  void writePin(uint8_t pin, uint8_t level);
+  uint8_t readPin(uint8_t pin);
+
+  // Next key held down on keypad or 0 if none. The keypad library drives the
+  // columns itself as it scans, so this doesn't depend on how they're driven.
+  char nextKey();
+
+  int serialRead();
+  void serialWrite(const uint8_t *buffer, size_t size);
+
+  // Calls an interrupt handler after the given time
+  void interruptAfter(uint64_t micros, void (*isr)());
+
+  // Stands in for an interrupt driven I2C transmission. done() is called once
+  // the bytes would have been sent. Returns false, sending nothing, if the
+  // address isn't acknowledged.
+  bool i2cTransmitInBackground(uint8_t address, const uint8_t *data, size_t size, void (*done)());
+  void setI2CClock(uint32_t frequency);
+}
+
+#endif
@@ -0,0 +1,47 @@
+#
+# check_no_heap.py
+#
+# PlatformIO post-build script for the firmware. Fails the build if the heap
+# allocator has been linked in, which means something uses the heap: over
+# months of uptime it would fragment the 2 KB of RAM.
+#
+# Looks for the allocator's symbols among those defined in the final ELF file,
+# with avr-nm, so the check doesn't depend on how the objects were compiled or
+# linked, e.g. with LTO. The allocator is only linked in from avr-libc if
+# something refers to it.
+#
+
+import subprocess
+
+Import("env")
+
+ALLOCATOR_SYMBOLS = ("malloc", "free", "realloc", "calloc")
+
+
+# The toolchain's nm: $NM if the environment sets it, otherwise the one with
+# the same prefix as the compiler, e.g. avr-gcc -> avr-nm
+def nm_tool(env):
+    if env.get("NM"):
+        return env.subst("$NM")
+    cc = env.subst("$CC")
+    if cc.endswith("gcc"):
+        return cc[:-len("gcc")] + "nm"
+    return "avr-nm"
+
+
+# Returns the allocator symbols defined in an ELF file, as listed by nm
+def heap_symbols(nm, elf):
+    output = subprocess.check_output([nm, "--defined-only", elf], universal_newlines=True)
+    defined = set(line.split()[-1] for line in output.splitlines() if line.strip())
+    return [symbol for symbol in ALLOCATOR_SYMBOLS if symbol in defined]
+
+
+def check_no_heap(source, target, env):
+    symbols = heap_symbols(nm_tool(env), str(target[0]))
+    if symbols:
+        print("Error: the firmware uses the heap: %s linked in. Add -Wl,-y,%s to build_flags to see what refers to it."
+              % (", ".join(symbols), symbols[0]))
+        env.Exit(1)
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check_no_heap)
@@ -0,0 +1,106 @@
+/*
+ * alarm_fsm.cpp
+ *
+ * Implementation of AlarmFsm. See alarm_fsm.h.
+ */
+
+#include "alarm_fsm.h"
+
+// Marks an event that can't happen in a state
+#define ILLEGAL   {STATE_COUNT, 0}
+
+// Transitions by state & event. Columns are in order of event: gate opened,
+// suspend, suspend forever, resume, reset & suspension timeout.
+static constexpr AlarmTransition TRANSITIONS[STATE_COUNT][EVENT_COUNT] PROGMEM = {
+  // STATE_ARMED
+  {
+    {STATE_ALARM, ACTION_OPEN_GATE | ACTION_SOUND_ALARM},
+    {STATE_SUSPENDED, ACTION_START_SUSPENSION},
+    {STATE_SUSPENDED_FOREVER, ACTION_START_SUSPENSION},
+    {STATE_ARMED, 0},
+    {STATE_ARMED, ACTION_RESET},
+    ILLEGAL
+  },
+  // STATE_ALARM
+  {
+    {STATE_ALARM, 0},
+    {STATE_SUSPENDED_OPEN, ACTION_START_SUSPENSION | ACTION_SILENCE_ALARM},
+    {STATE_SUSPENDED_FOREVER_OPEN, ACTION_START_SUSPENSION | ACTION_SILENCE_ALARM},
+    {STATE_ALARM, 0},
+    {STATE_ARMED, ACTION_RESET | ACTION_SILENCE_ALARM},
+    ILLEGAL
+  },
+  // STATE_SUSPENDED
+  {
+    {STATE_SUSPENDED_OPEN, ACTION_OPEN_GATE},
+    {STATE_SUSPENDED, ACTION_START_SUSPENSION},
+    {STATE_SUSPENDED_FOREVER, ACTION_START_SUSPENSION},
+    {STATE_ARMED, ACTION_END_SUSPENSION},
+    {STATE_ARMED, ACTION_RESET | ACTION_END_SUSPENSION},
+    {STATE_ARMED, ACTION_END_SUSPENSION}
+  },
+  // STATE_SUSPENDED_FOREVER
+  {
+    {STATE_SUSPENDED_FOREVER_OPEN, ACTION_OPEN_GATE},
+    {STATE_SUSPENDED, ACTION_START_SUSPENSION},
+    {STATE_SUSPENDED_FOREVER, ACTION_START_SUSPENSION},
+    {STATE_ARMED, ACTION_END_SUSPENSION},
+    {STATE_ARMED, ACTION_RESET | ACTION_END_SUSPENSION},
+    ILLEGAL
+  },
+  // STATE_SUSPENDED_OPEN
+  {
+    {STATE_SUSPENDED_OPEN, 0},
+    {STATE_SUSPENDED_OPEN, ACTION_START_SUSPENSION},
+    {STATE_SUSPENDED_FOREVER_OPEN, ACTION_START_SUSPENSION},
+    {STATE_ALARM, ACTION_END_SUSPENSION | ACTION_SOUND_ALARM},
+    {STATE_ARMED, ACTION_RESET | ACTION_END_SUSPENSION},
+    {STATE_ALARM, ACTION_END_SUSPENSION | ACTION_SOUND_ALARM}
+  },
+  // STATE_SUSPENDED_FOREVER_OPEN
+  {
+    {STATE_SUSPENDED_FOREVER_OPEN, 0},
+    {STATE_SUSPENDED_OPEN, ACTION_START_SUSPENSION},
+    {STATE_SUSPENDED_FOREVER_OPEN, ACTION_START_SUSPENSION},
+    {STATE_ALARM, ACTION_END_SUSPENSION | ACTION_SOUND_ALARM},
+    {STATE_ARMED, ACTION_RESET | ACTION_END_SUSPENSION},
+    ILLEGAL
+  }
+};
+
+// Checks at compile time that every legal transition leads to a valid state.
+// Recursive as the AVR toolchain only supports C++11 constexpr functions.
+static constexpr boolean isTransitionValid(const AlarmTransition &t) {
+  return t.next < STATE_COUNT || (t.next == STATE_COUNT && t.actions == 0);
+}
+
+static constexpr boolean isTableValid(byte i = 0) {
+  return i == STATE_COUNT * EVENT_COUNT
+    || (isTransitionValid(TRANSITIONS[i / EVENT_COUNT][i % EVENT_COUNT]) && isTableValid(i + 1));
+}
+
+static_assert(isTableValid(), "Alarm state transition table is invalid");
+
+byte AlarmFsm::dispatch(byte event) {
+  AlarmTransition t;
+  if (!transition(_state, event, t)) {
+    _illegalCount++;
+    return ACTION_ILLEGAL;
+  }
+  _state = t.next;
+  return t.actions;
+}
+
+boolean AlarmFsm::transition(byte state, byte event, AlarmTransition &result) {
+  if (state >= STATE_COUNT || event >= EVENT_COUNT) {
+    return false;
+  }
+  memcpy_P(&result, &TRANSITIONS[state][event], sizeof(result));
+  return result.next < STATE_COUNT;
+}
+
+void AlarmFsm::restore(byte state) {
+  if (state < STATE_COUNT) {
+    _state = state;
+  }
+}
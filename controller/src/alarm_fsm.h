@@ -0,0 +1,105 @@
+/*
+ * alarm_fsm.h
+ *
+ * State machine of the alarm controller: whether the gate has been opened,
+ * whether the alarm is sounding and whether it's suspended.
+ *
+ * Transitions are looked up in a table, held in flash, giving the next state &
+ * the actions to carry out for each event in each state. Events that can't
+ * happen in a state are marked as illegal & leave the state unchanged.
+ *
+ * The machine only decides what to do: carrying out the actions, which drive
+ * the outputs, is up to the caller. So it has no dependencies on hardware.
+ *
+ * Once opened, the gate counts as open until the alarm is reset, even if it's
+ * closed again. The alarm sounds whenever the gate is open & the alarm isn't
+ * suspended. Entry of a suspension time on the keypad isn't part of the state:
+ * it's only once the entry is finished that it results in an event.
+ */
+
+#ifndef _ALARM_FSM_H
+#define _ALARM_FSM_H
+
+#include <Arduino.h>
+
+// States
+#define STATE_ARMED                     0   // gate closed, alarm on guard
+#define STATE_ALARM                     1   // gate open, alarm sounding
+#define STATE_SUSPENDED                 2   // gate closed, suspended for a time
+#define STATE_SUSPENDED_FOREVER         3   // gate closed, suspended indefinitely
+#define STATE_SUSPENDED_OPEN            4   // gate open, suspended for a time
+#define STATE_SUSPENDED_FOREVER_OPEN    5   // gate open, suspended indefinitely
+#define STATE_COUNT                     6
+
+// Events
+#define EVENT_GATE_OPENED               0
+#define EVENT_SUSPEND                   1   // # after entering a time
+#define EVENT_SUSPEND_FOREVER           2   // # on its own
+#define EVENT_RESUME                    3   // # after entering 0
+#define EVENT_RESET                     4   // *
+#define EVENT_SUSPENSION_TIMEOUT        5
+#define EVENT_COUNT                     6
+
+// Actions, as bit flags. The caller carries out those in a transition in the
+// order listed here.
+#define ACTION_RESET                    0x01  // gate deemed closed
+#define ACTION_END_SUSPENSION           0x02
+#define ACTION_START_SUSPENSION         0x04  // timed or indefinite as per event
+#define ACTION_SILENCE_ALARM            0x08
+#define ACTION_OPEN_GATE                0x10
+#define ACTION_SOUND_ALARM              0x20
+
+// Returned by dispatch() for an illegal event
+#define ACTION_ILLEGAL                  0xFF
+
+struct AlarmTransition {
+  byte next;
+  byte actions;
+};
+
+class AlarmFsm {
+
+  public:
+
+    AlarmFsm() : _state(STATE_ARMED), _illegalCount(0) {}
+
+    byte state() const { return _state; }
+
+    // Moves to the next state for an event & returns the actions to carry out,
+    // or ACTION_ILLEGAL, leaving the state unchanged, if the event is illegal
+    // in the current state
+    byte dispatch(byte event);
+
+    // Looks up the transition for an event in a state. Returns false if the
+    // event is illegal in that state.
+    static boolean transition(byte state, byte event, AlarmTransition &result);
+
+    // Sets the state directly, e.g. to one saved before a reset
+    void restore(byte state);
+
+    // Number of illegal events since start up
+    unsigned int illegalCount() const { return _illegalCount; }
+
+    boolean isGateOpen() const {
+      return _state == STATE_ALARM || _state == STATE_SUSPENDED_OPEN || _state == STATE_SUSPENDED_FOREVER_OPEN;
+    }
+
+    boolean isAlarmSounding() const {
+      return _state == STATE_ALARM;
+    }
+
+    boolean isSuspended() const {
+      return _state != STATE_ARMED && _state != STATE_ALARM;
+    }
+
+    boolean isSuspendedForever() const {
+      return _state == STATE_SUSPENDED_FOREVER || _state == STATE_SUSPENDED_FOREVER_OPEN;
+    }
+
+  private:
+
+    byte _state;
+    unsigned int _illegalCount;
+};
+
+#endif
@@ -0,0 +1,301 @@
+/*
+ * async_lcd.cpp
+ *
+ * Implementation of AsyncLcd. See async_lcd.h.
+ */
+
+#include "async_lcd.h"
+
+#ifdef __AVR__
+#include <util/twi.h>
+#else
+#include "sim.h"
+#endif
+
+// PCF8574 pins
+#define EXPANDER_RS             0x01
+#define EXPANDER_ENABLE         0x04
+#define EXPANDER_BACKLIGHT      0x08
+
+// Expander bytes sent for each nibble: data & RS with E low, so they're set up
+// before E rises, then with E high, then with E low to latch them
+#define EXPANDER_BYTES_PER_NIBBLE   3
+
+// HD44780 instructions & flags
+#define LCD_CLEAR_DISPLAY       0x01
+#define LCD_ENTRY_MODE_SET      0x04
+#define LCD_DISPLAY_CONTROL     0x08
+#define LCD_FUNCTION_SET        0x20
+#define LCD_SET_DDRAM_ADDRESS   0x80
+
+#define LCD_ENTRY_LEFT          0x02
+#define LCD_DISPLAY_ON          0x04
+#define LCD_2_LINE              0x08
+
+// Execution time of clear display in us, with a margin for a slow oscillator
+#define LCD_CLEAR_TIME          2000
+
+// Time after power on before the HD44780 accepts instructions, in us
+#define LCD_POWER_UP_TIME       50000
+
+// Queued operations
+#define OP_NIBBLE               0   // high nibble of value as an instruction
+#define OP_COMMAND              1   // value is an instruction
+#define OP_DATA                 2   // value is a character
+#define OP_DELAY                3   // value is number of idle bytes to send
+#define OP_BACKLIGHT            4   // value is non-zero for on
+
+// Bytes sent to the expander by an operation
+static byte operationLength(byte type, byte value) {
+  switch (type) {
+    case OP_NIBBLE:
+      return EXPANDER_BYTES_PER_NIBBLE;
+    case OP_COMMAND:
+    case OP_DATA:
+      return 2 * EXPANDER_BYTES_PER_NIBBLE;
+    case OP_DELAY:
+      return value;
+    default:
+      return 1;
+  }
+}
+
+SpscQueue<AsyncLcd::Operation, ASYNC_LCD_QUEUE_SIZE> AsyncLcd::_queue;
+byte AsyncLcd::_address = 0;
+volatile boolean AsyncLcd::_busy = false;
+volatile unsigned int AsyncLcd::_errorCount = 0;
+volatile unsigned long AsyncLcd::_bytesSent = 0;
+byte AsyncLcd::_backlightBit = 0;
+AsyncLcd::Operation AsyncLcd::_current = {OP_DELAY, 0};
+byte AsyncLcd::_sent = 0;
+
+#ifdef __AVR__
+
+ISR(TWI_vect) {
+  AsyncLcd::onInterrupt();
+}
+
+void AsyncLcd::onInterrupt() {
+  byte b;
+  switch (TW_STATUS) {
+    case TW_START:
+    case TW_REP_START:
+      TWDR = (_address << 1) | TW_WRITE;
+      TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+      break;
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+      if (nextByte(b)) {
+        TWDR = b;
+        TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+      }
+      else {
+        TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+        _busy = false;
+      }
+      break;
+    default:
+      // Not acknowledged or arbitration lost
+      TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+      _errorCount++;
+      discardQueue();
+      _busy = false;
+      break;
+  }
+}
+
+#else
+
+// Largest number of bytes sent in one go by the host version of the interrupt
+#define HOST_CHUNK_SIZE   16
+
+// Stands in for the TWI interrupt: sends queued bytes a few at a time, each
+// chunk taking as long to finish as it would on the bus
+void AsyncLcd::onInterrupt() {
+  byte buffer[HOST_CHUNK_SIZE];
+  size_t length = 0;
+  while (length < HOST_CHUNK_SIZE && nextByte(buffer[length])) {
+    length++;
+  }
+  if (length == 0) {
+    _busy = false;
+    return;
+  }
+  if (!sim::i2cTransmitInBackground(_address, buffer, length, onInterrupt)) {
+    // Nothing was sent, as the address wasn't acknowledged
+    _bytesSent -= length;
+    _errorCount++;
+    discardQueue();
+    _busy = false;
+  }
+}
+
+#endif
+
+AsyncLcd::AsyncLcd(byte address) : _backlightOn(false) {
+  _address = address;
+}
+
+void AsyncLcd::begin() {
+#ifdef __AVR__
+  // Internal pull-ups as well as any on the backpack, as Wire does
+  pinMode(SDA, INPUT_PULLUP);
+  pinMode(SCL, INPUT_PULLUP);
+  TWSR = 0;
+  TWBR = (F_CPU / ASYNC_LCD_I2C_CLOCK - 16) / 2;
+  TWCR = _BV(TWEN);
+#else
+  sim::setI2CClock(ASYNC_LCD_I2C_CLOCK);
+#endif
+  initialise();
+}
+
+// Queues the whole initialisation, leaving the display cleared with the
+// backlight on
+void AsyncLcd::initialise() {
+  _backlightOn = true;
+  enqueue(OP_BACKLIGHT, 1);
+  // Wait for HD44780 to power up
+  delayFor(LCD_POWER_UP_TIME);
+  // Initialisation by instruction, see HD44780 datasheet figure 24, since the
+  // display may be in either 8 or 4 bit mode after a reset of the MCU alone
+  enqueue(OP_NIBBLE, 0x30);
+  delayFor(4500);
+  enqueue(OP_NIBBLE, 0x30);
+  delayFor(4500);
+  enqueue(OP_NIBBLE, 0x30);
+  delayFor(150);
+  enqueue(OP_NIBBLE, 0x20);
+  command(LCD_FUNCTION_SET | LCD_2_LINE);
+  command(LCD_DISPLAY_CONTROL | LCD_DISPLAY_ON);
+  clear();
+  command(LCD_ENTRY_MODE_SET | LCD_ENTRY_LEFT);
+}
+
+void AsyncLcd::reinitialise() {
+  boolean backlightOn = _backlightOn;
+  initialise();
+  if (!backlightOn) {
+    noBacklight();
+  }
+}
+
+void AsyncLcd::clear() {
+  command(LCD_CLEAR_DISPLAY);
+  delayFor(LCD_CLEAR_TIME);
+}
+
+void AsyncLcd::setCursor(byte col, byte row) {
+  static const byte ROW_ADDRESSES[] = {0x00, 0x40, 0x14, 0x54};
+  command(LCD_SET_DDRAM_ADDRESS | (col + ROW_ADDRESSES[row & 0x03]));
+}
+
+void AsyncLcd::write(char c) {
+  enqueue(OP_DATA, c);
+}
+
+unsigned long AsyncLcd::bytesSent() const {
+  // Updated by the interrupt & more than one byte long
+  noInterrupts();
+  unsigned long sent = _bytesSent;
+  interrupts();
+  return sent;
+}
+
+void AsyncLcd::backlight() {
+  if (!_backlightOn) {
+    _backlightOn = true;
+    enqueue(OP_BACKLIGHT, 1);
+  }
+}
+
+void AsyncLcd::noBacklight() {
+  if (_backlightOn) {
+    _backlightOn = false;
+    enqueue(OP_BACKLIGHT, 0);
+  }
+}
+
+void AsyncLcd::command(byte value) {
+  enqueue(OP_COMMAND, value);
+}
+
+// Keeps the bus busy for at least the given time after the previous operation
+void AsyncLcd::delayFor(unsigned int us) {
+  unsigned int bytes = (us + ASYNC_LCD_BYTE_TIME - 1) / ASYNC_LCD_BYTE_TIME;
+  while (bytes > 0) {
+    byte count = min(bytes, 255u);
+    enqueue(OP_DELAY, count);
+    bytes -= count;
+  }
+}
+
+void AsyncLcd::enqueue(byte type, byte value) {
+  // Only waits if a lot is already queued
+  while (_queue.isFull()) {
+    delayMicroseconds(ASYNC_LCD_BYTE_TIME);
+  }
+  Operation operation = {type, value};
+  _queue.push(operation);
+  startTransfer();
+}
+
+// Starts a transmission if one isn't already under way. The interrupt keeps it
+// going until the queue is empty.
+void AsyncLcd::startTransfer() {
+  noInterrupts();
+  if (_busy || _queue.isEmpty()) {
+    interrupts();
+    return;
+  }
+  _busy = true;
+#ifdef __AVR__
+  // Wait for any stop condition from the last transmission to go out
+  while (TWCR & _BV(TWSTO)) {}
+  TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA);
+  interrupts();
+#else
+  interrupts();
+  onInterrupt();
+#endif
+}
+
+// Interrupt only. Gets the next byte to send to the expander, if any.
+boolean AsyncLcd::nextByte(byte &b) {
+  while (_sent == operationLength(_current.type, _current.value)) {
+    if (!_queue.pop(_current)) {
+      return false;
+    }
+    _sent = 0;
+    if (_current.type == OP_BACKLIGHT) {
+      _backlightBit = _current.value ? EXPANDER_BACKLIGHT : 0;
+    }
+  }
+  switch (_current.type) {
+    case OP_NIBBLE:
+    case OP_COMMAND:
+    case OP_DATA: {
+      // E low, high then low for each nibble: HD44780 reads data on falling
+      // edge, and needs RS set up before E rises
+      byte nibble = _sent < EXPANDER_BYTES_PER_NIBBLE ? (_current.value & 0xF0) : (_current.value << 4);
+      b = nibble | (_current.type == OP_DATA ? EXPANDER_RS : 0) | _backlightBit
+        | ((_sent % EXPANDER_BYTES_PER_NIBBLE) == 1 ? EXPANDER_ENABLE : 0);
+      break;
+    }
+    default:
+      b = _backlightBit;
+      break;
+  }
+  _sent++;
+  _bytesSent++;
+  return true;
+}
+
+// Interrupt only
+void AsyncLcd::discardQueue() {
+  Operation operation;
+  while (_queue.pop(operation)) {}
+  _current.type = OP_DELAY;
+  _current.value = 0;
+  _sent = 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * async_lcd.h
+ *
+ * Driver for a HD44780 LCD behind a PCF8574 I2C port expander, wired as on the
+ * common LCD backpack: P0 = RS, P1 = RW, P2 = E, P3 = backlight and P4..P7 =
+ * D4..D7.
+ *
+ * Writes to the display don't wait for the I2C bus. They are added to a queue
+ * and streamed to the expander by the TWI interrupt, so the main loop carries
+ * on while the display updates. Only if the queue is full does a write wait for
+ * space.
+ *
+ * The expander's outputs change as each byte arrives, so all queued bytes are
+ * sent in a single I2C transmission. Each byte for the HD44780 takes 6 expander
+ * bytes (high nibble with E low, high then low again, so RS & the data are set
+ * up before E rises, then the same for the low nibble), 540 us at 100 kHz. This
+ * is long enough for all instructions except clear & home, after which the
+ * driver pads the transmission with idle bytes until the instruction is done.
+ *
+ * Uses the TWI hardware directly, so can't be used with the Wire library.
+ */
+
+#ifndef _ASYNC_LCD_H
+#define _ASYNC_LCD_H
+
+#include <Arduino.h>
+#include "spsc_queue.h"
+
+// Bus clock. 100 kHz is the maximum for the PCF8574.
+#define ASYNC_LCD_I2C_CLOCK     100000UL
+
+// Time for one byte on the bus, including ACK, in us
+#define ASYNC_LCD_BYTE_TIME     (9 * 1000000UL / ASYNC_LCD_I2C_CLOCK)
+
+// Number of queued operations, each taking 2 bytes of SRAM. Enough for two
+// complete redraws of a 16x2 display including cursor moves. Must be a power of
+// 2.
+#define ASYNC_LCD_QUEUE_SIZE    64
+
+class AsyncLcd {
+
+  public:
+
+    AsyncLcd(byte address);
+
+    // Sets up the I2C bus & queues initialisation of the display, including
+    // the wait for it to power up, so returns straight away. Display is cleared
+    // with the backlight on.
+    void begin();
+
+    // Queues initialisation of the display again, as begin() but keeping the
+    // backlight as it is. After a failed transmission the HD44780 may have had
+    // only half of a byte, or none of its initialisation, so is out of step
+    // with what's sent until it's initialised again.
+    void reinitialise();
+
+    // Clears display & homes cursor
+    void clear();
+
+    void setCursor(byte col, byte row);
+    void write(char c);
+
+    void backlight();
+    void noBacklight();
+
+    // Returns true while there are queued writes still to be sent
+    boolean isBusy() const { return _busy; }
+
+    // Number of failed transmissions, e.g. with no display connected, since
+    // start up. Any writes queued at the time of a failure are discarded.
+    unsigned int errorCount() const { return _errorCount; }
+
+    // Number of bytes sent to the expander since start up, counted as each
+    // goes out on the bus
+    unsigned long bytesSent() const;
+
+    // Called from the TWI interrupt
+    static void onInterrupt();
+
+  private:
+
+    struct Operation {
+      byte type;
+      byte value;
+    };
+
+    static SpscQueue<Operation, ASYNC_LCD_QUEUE_SIZE> _queue;
+    static byte _address;
+    static volatile boolean _busy;
+    static volatile unsigned int _errorCount;
+    static volatile unsigned long _bytesSent;
+    // Backlight bit output with every expander byte
+    static byte _backlightBit;
+    // Operation being sent by interrupt & number of its expander bytes sent
+    static Operation _current;
+    static byte _sent;
+
+    // Backlight state as last queued
+    boolean _backlightOn;
+
+    void initialise();
+    void enqueue(byte type, byte value);
+    void command(byte value);
+    void delayFor(unsigned int us);
+    static void startTransfer();
+    static boolean nextByte(byte &b);
+    static void discardQueue();
+};
+
+#endif
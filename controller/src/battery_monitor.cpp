@@ -0,0 +1,36 @@
+/*
+ * battery_monitor.cpp
+ *
+ * Implementation of BatteryMonitor. See battery_monitor.h.
+ */
+
+#include "battery_monitor.h"
+
+#ifndef __AVR__
+#include "sim.h"
+#endif
+
+// Nominal voltage of bandgap reference in mV
+#define BANDGAP_VOLTAGE   1100UL
+
+void BatteryMonitor::start() {
+#ifdef __AVR__
+  // ADC clock 16 MHz / 128 = 125 kHz. Reference AVcc, input bandgap.
+  ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+  ADMUX = _BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1);
+#endif
+}
+
+unsigned int BatteryMonitor::finish() {
+#ifdef __AVR__
+  // Conversion takes about 100 us
+  ADCSRA |= _BV(ADSC);
+  while (ADCSRA & _BV(ADSC)) {}
+  unsigned int reading = ADC;
+  ADCSRA = 0;
+  // Reading is bandgap voltage as a fraction of supply voltage, in 1024ths
+  return reading == 0 ? 0 : BANDGAP_VOLTAGE * 1024 / reading;
+#else
+  return sim::supplyVoltage();
+#endif
+}
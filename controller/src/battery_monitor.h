@@ -0,0 +1,38 @@
+/*
+ * battery_monitor.h
+ *
+ * Measures the MCU's supply voltage, so a flat battery can be reported before
+ * the alarm stops working.
+ *
+ * The ADC measures the internal 1.1 V bandgap reference against the supply
+ * voltage, from which the supply voltage is worked out. No pin is needed. The
+ * bandgap reference is only accurate to about 10%, which is good enough to
+ * spot a failing battery.
+ *
+ * The reference takes a while to settle after the ADC is switched to it, so a
+ * measurement is made in two parts: start() sets up the ADC & finish(), called
+ * at least BATTERY_MONITOR_SETTLE_TIME ms later, reads it. The ADC is switched
+ * off in between measurements to save power.
+ */
+
+#ifndef _BATTERY_MONITOR_H
+#define _BATTERY_MONITOR_H
+
+#include <Arduino.h>
+
+// Time in ms for bandgap reference to settle
+#define BATTERY_MONITOR_SETTLE_TIME   2
+
+class BatteryMonitor {
+
+  public:
+
+    // Switches on the ADC & selects the bandgap reference
+    static void start();
+
+    // Measures the supply voltage & switches off the ADC. Returns the voltage
+    // in mV.
+    static unsigned int finish();
+};
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * crc8.cpp
+ *
+ * Implementation of crc8(). See crc8.h.
+ */
+
+#include "crc8.h"
+
+#define CRC8_POLYNOMIAL   0x07
+
+byte crc8(const void *data, byte length, byte crc) {
+  const byte *p = (const byte *) data;
+  while (length--) {
+    crc ^= *p++;
+    for (byte bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ CRC8_POLYNOMIAL : crc << 1;
+    }
+  }
+  return crc;
+}
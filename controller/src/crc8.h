@@ -0,0 +1,16 @@
+/*
+ * crc8.h
+ *
+ * CRC-8 with polynomial 0x07, as used by SMBus, for checking data kept in
+ * EEPROM.
+ */
+
+#ifndef _CRC8_H
+#define _CRC8_H
+
+#include <Arduino.h>
+
+// Returns CRC of data, continuing from a previous CRC if one is given
+byte crc8(const void *data, byte length, byte crc = 0);
+
+#endif
@@ -1,8 +1,14 @@
 /*
  * debug.h
  *
- * Provides a set of macros that write debugging data to the Serial port iff the
- * DEBUG macro is defined.
+ * Provides a set of macros that write debugging data to the serial port iff the
+ * DEBUG macro is defined. Output is buffered & sent in the background by
+ * serialLog, which must be defined by the sketch when DEBUG is defined.
+ *
+ * DBGlog() and DBGlog1() .. DBGlog3() write one of the messages listed in
+ * log_messages.def with the given number of arguments. If DEBUG_TOKENS is
+ * defined as well as DEBUG they are written as compact binary records, for
+ * decoding by tools/log_decode, and the message text isn't stored in flash.
  */
 
 #ifndef _DEBUG_H
@@ -10,12 +16,31 @@
 
 #ifdef DEBUG
 
-#define DBGbegin(baud) Serial.begin((baud))
-#define DBGprint(s) Serial.print((s))
-#define DBGprintfmt(s, fmt)  Serial.print((s), (fmt))
-#define DBGprintln(s) Serial.println((s))
-#define DBGprintlnfmt(s, fmt)  Serial.println((s), (fmt))
-#define DBGblankln() Serial.println()
+#include "serial_log.h"
+
+extern SerialLog serialLog;
+
+#define DBGbegin(baud) serialLog.begin((baud))
+#define DBGprint(s) serialLog.print((s))
+#define DBGprintfmt(s, fmt)  serialLog.print((s), (fmt))
+#define DBGprintln(s) serialLog.println((s))
+#define DBGprintlnfmt(s, fmt)  serialLog.println((s), (fmt))
+#define DBGblankln() serialLog.println()
+#define DBGflush() serialLog.flush()
+#define DBGread() serialLog.read()
+
+#include "log.h"
+
+#ifdef DEBUG_TOKENS
+#define DBGlogwrite logRecord
+#else
+#define DBGlogwrite logText
+#endif
+
+#define DBGlog(id) DBGlogwrite(serialLog, LOG_##id, 0)
+#define DBGlog1(id, a) DBGlogwrite(serialLog, LOG_##id, 1, (a))
+#define DBGlog2(id, a, b) DBGlogwrite(serialLog, LOG_##id, 2, (a), (b))
+#define DBGlog3(id, a, b, c) DBGlogwrite(serialLog, LOG_##id, 3, (a), (b), (c))
 
 #else
 
@@ -25,6 +50,12 @@
 #define DBGprintln(s)
 #define DBGprintlnfmt(s, p)
 #define DBGblankln()
+#define DBGflush()
+#define DBGread() (-1)
+#define DBGlog(id)
+#define DBGlog1(id, a)
+#define DBGlog2(id, a, b)
+#define DBGlog3(id, a, b, c)
 
 #endif
 
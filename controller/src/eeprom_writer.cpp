@@ -0,0 +1,111 @@
+/*
+ * eeprom_writer.cpp
+ *
+ * Implementation of EepromWriter. See eeprom_writer.h.
+ */
+
+#include "eeprom_writer.h"
+
+#ifndef __AVR__
+#include "sim.h"
+
+// Time to write an EEPROM byte in us
+#define EEPROM_WRITE_TIME   3400
+#endif
+
+SpscQueue<byte, EEPROM_WRITER_QUEUE_SIZE> EepromWriter::_data;
+SpscQueue<EepromWriter::Job, EEPROM_WRITER_JOBS> EepromWriter::_jobs;
+volatile boolean EepromWriter::_busy = false;
+EepromWriter::Job EepromWriter::_current = {0, 0};
+byte EepromWriter::_done = 0;
+
+#ifdef __AVR__
+ISR(EE_READY_vect) {
+  EepromWriter::onReady();
+}
+#endif
+
+boolean EepromWriter::write(unsigned int address, const void *data, byte length) {
+  if (_data.space() < length || _jobs.isFull()) {
+    return false;
+  }
+  const byte *p = (const byte *) data;
+  for (byte i = 0; i < length; i++) {
+    _data.push(p[i]);
+  }
+  Job job = {address, length};
+  noInterrupts();
+  _jobs.push(job);
+  if (!_busy) {
+    _busy = true;
+#ifdef __AVR__
+    EECR |= _BV(EERIE);
+#else
+    sim::interruptAfter(0, onReady);
+#endif
+  }
+  interrupts();
+  return true;
+}
+
+void EepromWriter::read(unsigned int address, void *data, byte length) {
+  byte *p = (byte *) data;
+  for (byte i = 0; i < length; i++) {
+#ifdef __AVR__
+    // Interrupt mustn't start a write between waiting & reading
+    noInterrupts();
+    while (EECR & _BV(EEPE)) {}
+    EEAR = address + i;
+    EECR |= _BV(EERE);
+    p[i] = EEDR;
+    interrupts();
+#else
+    p[i] = sim::eeprom()[(address + i) % EEPROM_WRITER_SIZE];
+#endif
+  }
+}
+
+void EepromWriter::stop() {
+#ifdef __AVR__
+  EECR &= ~_BV(EERIE);
+#endif
+  _busy = false;
+}
+
+void EepromWriter::onReady() {
+  while (_done == _current.length) {
+    if (!_jobs.pop(_current)) {
+      stop();
+      return;
+    }
+    _done = 0;
+  }
+  byte value;
+  // A job's data is queued before the job, so this only fails if the queues
+  // are out of step: drop the job rather than write a byte that isn't there
+  if (!_data.pop(value)) {
+    _done = _current.length;
+    stop();
+    return;
+  }
+  unsigned int address = _current.address + _done++;
+#ifdef __AVR__
+  EEAR = address;
+  EECR |= _BV(EERE);
+  if (EEDR != value) {
+    EEDR = value;
+    // Erase & write. EEPE must be set within 4 cycles of EEMPE.
+    EECR = _BV(EERIE) | _BV(EEMPE);
+    EECR |= _BV(EEPE);
+  }
+#else
+  uint8_t &cell = sim::eeprom()[address % EEPROM_WRITER_SIZE];
+  if (cell != value) {
+    cell = value;
+    sim::interruptAfter(EEPROM_WRITE_TIME, onReady);
+  }
+  else {
+    sim::interruptAfter(0, onReady);
+  }
+#endif
+}
@@ -0,0 +1,64 @@
+/*
+ * eeprom_writer.h
+ *
+ * Writes to EEPROM in the background. Each byte takes 3.4 ms to write, so
+ * instead of waiting, data is queued and written a byte at a time by the
+ * EEPROM ready interrupt. Bytes that already hold the value being written
+ * aren't written again, to save wear.
+ *
+ * EEPROM ready can't wake the MCU from power-down, so it must not power down
+ * while isBusy().
+ */
+
+#ifndef _EEPROM_WRITER_H
+#define _EEPROM_WRITER_H
+
+#include <Arduino.h>
+#include "spsc_queue.h"
+
+// Size of EEPROM in bytes
+#define EEPROM_WRITER_SIZE        1024
+
+// Bytes of data & number of separate writes that can be queued. Must be
+// powers of 2, no greater than 128. Big enough for everything one pass of the
+// main loop can write, which main.cpp checks.
+#define EEPROM_WRITER_QUEUE_SIZE  128
+#define EEPROM_WRITER_JOBS        16
+
+class EepromWriter {
+
+  public:
+
+    // Queues data to be written at the given address. Returns false, without
+    // queueing anything, if there isn't room.
+    boolean write(unsigned int address, const void *data, byte length);
+
+    // Returns true while there are queued writes still to finish
+    boolean isBusy() const { return _busy; }
+
+    // Reads from EEPROM, waiting for any byte being written to finish first.
+    // Doesn't see data still queued.
+    static void read(unsigned int address, void *data, byte length);
+
+    // Called from the EEPROM ready interrupt
+    static void onReady();
+
+  private:
+
+    struct Job {
+      unsigned int address;
+      byte length;
+    };
+
+    static SpscQueue<byte, EEPROM_WRITER_QUEUE_SIZE> _data;
+    static SpscQueue<Job, EEPROM_WRITER_JOBS> _jobs;
+    static volatile boolean _busy;
+    // Job being written by interrupt & number of its bytes done
+    static Job _current;
+    static byte _done;
+
+    // Disables the ready interrupt once there's nothing left to write
+    static void stop();
+};
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * fast_pin.h
+ *
+ * Digital I/O for the Arduino Nano's ATmega328P with the port & bit of the pin
+ * resolved at compile time. FastPin<N> refers to Arduino pin N, using the same
+ * numbering as digitalWrite() etc.
+ *
+ * digitalWrite() has to look up the port & bit mask for the pin in flash
+ * tables, check whether the pin has a PWM timer to turn off, and save SREG &
+ * disable interrupts around a read-modify-write of the port. FastPin compiles
+ * to a single instruction because the port address is a constant in the I/O
+ * space.
+ *
+ * Approximate cycle counts at 16 MHz. The Arduino core figures include call
+ * overhead. All the FastPin ones but the last are for functions that are
+ * always inlined, so have none:
+ *
+ *   Operation                    Arduino core      FastPin
+ *   ---------------------------  ----------------  --------------------------
+ *   set pin HIGH or LOW          ~55 digitalWrite  2 (sbi / cbi)
+ *   read pin                     ~50 digitalRead   2-3 (sbic / sbis, or in)
+ *   set pin mode                 ~45 pinMode       2 (sbi / cbi on DDRx)
+ *   write level via a PinWriter  ~55 digitalWrite  ~16 (load pointer & level,
+ *                                                  icall, tst, branch,
+ *                                                  sbi / cbi, ret)
+ *
+ * write() is only worth 4 cycles (branch + sbi / cbi) where it's inlined, with
+ * the pin known at compile time. Its one run time use is through a PinWriter,
+ * when PulseEngine::tick() sets a channel's pin from the Timer1 interrupt, so
+ * it's never inlined there. An interrupt handler that makes any call must
+ * also save the call-clobbered registers, but the Timer1 handler already does,
+ * for tick()'s call to its tick handler.
+ *
+ * Unlike digitalWrite(), FastPin does not disconnect a PWM timer from the pin.
+ *
+ * In the host (native) build there are no port registers, so FastPin forwards
+ * to the simulated pinMode() etc.
+ */
+
+#ifndef _FAST_PIN_H
+#define _FAST_PIN_H
+
+#include <Arduino.h>
+
+#ifdef __AVR__
+
+template <byte PIN>
+class FastPin {
+
+  static_assert(PIN < 20, "FastPin only supports the Nano's digital pins 0..19");
+
+  public:
+
+    static const byte MASK = 1 << (PIN < 8 ? PIN : PIN < 14 ? PIN - 8 : PIN - 14);
+
+    static inline void output() __attribute__((always_inline)) {
+      ddr() |= MASK;
+    }
+
+    static inline void input() __attribute__((always_inline)) {
+      ddr() &= ~MASK;
+      port() &= ~MASK;
+    }
+
+    static inline void inputPullup() __attribute__((always_inline)) {
+      ddr() &= ~MASK;
+      port() |= MASK;
+    }
+
+    static inline void high() __attribute__((always_inline)) {
+      port() |= MASK;
+    }
+
+    static inline void low() __attribute__((always_inline)) {
+      port() &= ~MASK;
+    }
+
+    // Not always inlined, so that a pointer to it can be used where a pin must
+    // be chosen at run time
+    static void write(byte level) {
+      if (level) {
+        high();
+      }
+      else {
+        low();
+      }
+    }
+
+    static inline byte read() __attribute__((always_inline)) {
+      return (pin() & MASK) ? HIGH : LOW;
+    }
+
+  private:
+
+    static inline volatile uint8_t &port() __attribute__((always_inline)) {
+      return PIN < 8 ? PORTD : PIN < 14 ? PORTB : PORTC;
+    }
+
+    static inline volatile uint8_t &ddr() __attribute__((always_inline)) {
+      return PIN < 8 ? DDRD : PIN < 14 ? DDRB : DDRC;
+    }
+
+    static inline volatile uint8_t &pin() __attribute__((always_inline)) {
+      return PIN < 8 ? PIND : PIN < 14 ? PINB : PINC;
+    }
+};
+
+#else
+
+template <byte PIN>
+class FastPin {
+
+  static_assert(PIN < 20, "FastPin only supports the Nano's digital pins 0..19");
+
+  public:
+
+    static inline void output() { pinMode(PIN, OUTPUT); }
+    static inline void input() { pinMode(PIN, INPUT); }
+    static inline void inputPullup() { pinMode(PIN, INPUT_PULLUP); }
+    static inline void high() { digitalWrite(PIN, HIGH); }
+    static inline void low() { digitalWrite(PIN, LOW); }
+    static void write(byte level) { digitalWrite(PIN, level); }
+    static inline byte read() { return digitalRead(PIN); }
+};
+
+#endif
+
+// Function that sets the level of an output pin: FastPin<N>::write
+typedef void (*PinWriter)(byte level);
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * journal.cpp
+ *
+ * Implementation of Journal. See journal.h.
+ */
+
+#include "journal.h"
+#include "crc8.h"
+
+// Sequence numbers run from 0 to JOURNAL_SEQUENCE_LIMIT - 1
+#define JOURNAL_SEQUENCE_LIMIT  0xFFFFU
+
+static uint16_t nextSequence(uint16_t sequence) {
+  return sequence + 1 == JOURNAL_SEQUENCE_LIMIT ? 0 : sequence + 1;
+}
+
+static byte recordCrc(JournalRecord record) {
+  record.crc = 0;
+  return crc8(&record, sizeof(record));
+}
+
+// Returns true if a record was written in the same pass round the ring as the
+// record in slot 0
+static boolean isSameLap(const JournalRecord &record, const JournalRecord &first, byte slot) {
+  uint16_t ahead = record.sequence >= first.sequence
+    ? record.sequence - first.sequence
+    : record.sequence + JOURNAL_SEQUENCE_LIMIT - first.sequence;
+  return ahead == slot;
+}
+
+Journal::Journal(EepromWriter &writer) : _writer(writer), _next(0), _nextSequence(0), _count(0), _lost(0) {}
+
+void Journal::begin() {
+  JournalRecord first;
+  if (!readSlot(0, first)) {
+    // Either nothing has been recorded yet, or the ring has wrapped and the
+    // newest record, in slot 0, was only partly written
+    JournalRecord last;
+    if (readSlot(JOURNAL_SLOTS - 1, last)) {
+      _nextSequence = nextSequence(last.sequence);
+      _count = JOURNAL_SLOTS;
+    }
+    return;
+  }
+  // Newest record is in the last slot in the same lap as slot 0
+  byte low = 0;
+  byte high = JOURNAL_SLOTS - 1;
+  JournalRecord record;
+  while (low < high) {
+    byte mid = (low + high + 1) / 2;
+    readSlot(mid, record);
+    if (isSameLap(record, first, mid)) {
+      low = mid;
+    }
+    else {
+      high = mid - 1;
+    }
+  }
+  // Step back over a newest record that was only partly written
+  byte newest = low;
+  while (newest > 0 && !readSlot(newest, record)) {
+    newest--;
+  }
+  readSlot(newest, record);
+  _next = (newest + 1) % JOURNAL_SLOTS;
+  _nextSequence = nextSequence(record.sequence);
+  // Ring has wrapped if there's an older record after the newest one. The slot
+  // after the newest may hold a partly written record.
+  JournalRecord after;
+  boolean wrapped = readSlot(_next, after) || (_next + 1 < JOURNAL_SLOTS && readSlot(_next + 1, after));
+  _count = wrapped ? JOURNAL_SLOTS : newest + 1;
+}
+
+boolean Journal::record(byte event, unsigned long duration) {
+  JournalRecord record;
+  record.sequence = _nextSequence;
+  record.event = event;
+  record.time = millis();
+  record.duration = duration;
+  record.crc = recordCrc(record);
+  if (!_writer.write(JOURNAL_START + _next * sizeof(JournalRecord), &record, sizeof(record))) {
+    _lost++;
+    return false;
+  }
+  _next = (_next + 1) % JOURNAL_SLOTS;
+  _nextSequence = nextSequence(_nextSequence);
+  if (_count < JOURNAL_SLOTS) {
+    _count++;
+  }
+  return true;
+}
+
+boolean Journal::read(byte index, JournalRecord &record) const {
+  byte oldest = (_next + JOURNAL_SLOTS - _count) % JOURNAL_SLOTS;
+  return readSlot((oldest + index) % JOURNAL_SLOTS, record);
+}
+
+boolean Journal::readSlot(byte slot, JournalRecord &record) {
+  EepromWriter::read(JOURNAL_START + slot * sizeof(JournalRecord), &record, sizeof(record));
+  return record.sequence < JOURNAL_SEQUENCE_LIMIT && record.crc == recordCrc(record);
+}
@@ -0,0 +1,91 @@
+/*
+ * journal.h
+ *
+ * Persistent log of gate & alarm events kept in EEPROM, so history survives a
+ * reset or power loss.
+ *
+ * Records are written in turn to a ring of fixed size slots, so wear is spread
+ * evenly over them: with 80 slots, each is written once per 80 events. Each
+ * record has a sequence number, one more than the record before, skipping
+ * 0xFFFF which is what erased EEPROM reads as. Every record written since the
+ * ring last wrapped has a sequence number exactly its slot number ahead of
+ * slot 0's, and none of the older records do, so the newest record is found by
+ * a binary search reading only a few slots.
+ *
+ * Writes are queued with an EepromWriter, so recording an event doesn't wait
+ * for EEPROM.
+ */
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include <Arduino.h>
+#include "eeprom_writer.h"
+
+// EEPROM used by journal. The rest is free for other uses.
+#define JOURNAL_START         0
+#define JOURNAL_SLOTS         80
+
+// Events. Meaning of a record's duration is given for each.
+#define JOURNAL_BOOT                1   // MCUSR reset flags
+#define JOURNAL_GATE_OPENED         2   // zone number, from 1
+#define JOURNAL_ALARM_ACTIVATED     3   // 0
+#define JOURNAL_ALARM_SILENCED      4   // ms alarm sounded
+#define JOURNAL_SUSPENDED           5   // ms requested, JOURNAL_FOREVER if infinite
+#define JOURNAL_SUSPENSION_ENDED    6   // ms suspended
+#define JOURNAL_RESET               7   // ms gate was open, 0 if it wasn't
+
+#define JOURNAL_FOREVER       0xFFFFFFFFUL
+
+struct JournalRecord {
+  uint16_t sequence;
+  byte event;
+  // CRC of record with this field set to 0
+  byte crc;
+  // millis() when recorded
+  uint32_t time;
+  uint32_t duration;
+};
+
+static_assert(sizeof(JournalRecord) == 12, "JournalRecord layout must match records in EEPROM");
+
+// End of EEPROM used by journal
+#define JOURNAL_END   (JOURNAL_START + JOURNAL_SLOTS * sizeof(JournalRecord))
+
+class Journal {
+
+  public:
+
+    Journal(EepromWriter &writer);
+
+    // Finds the newest record. Call once at start up, before record().
+    void begin();
+
+    // Queues a record of an event. Returns false, and counts the record as
+    // lost, if the EEPROM write queue is full.
+    boolean record(byte event, unsigned long duration);
+
+    // Number of records held, up to JOURNAL_SLOTS
+    byte count() const { return _count; }
+
+    // Reads a record, counting from 0 for the oldest. Returns false if the
+    // record is invalid, e.g. it was being written when power failed. Records
+    // still queued for writing aren't seen.
+    boolean read(byte index, JournalRecord &record) const;
+
+    // Number of records not written because the write queue was full
+    unsigned int lostCount() const { return _lost; }
+
+  private:
+
+    EepromWriter &_writer;
+    // Slot for next record
+    byte _next;
+    uint16_t _nextSequence;
+    byte _count;
+    unsigned int _lost;
+
+    static boolean readSlot(byte slot, JournalRecord &record);
+};
+
+#endif
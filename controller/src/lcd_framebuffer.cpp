@@ -0,0 +1,78 @@
+/*
+ * lcd_framebuffer.cpp
+ *
+ * Implementation of LcdFrameBuffer. See lcd_framebuffer.h.
+ */
+
+#include "lcd_framebuffer.h"
+
+LcdFrameBuffer::LcdFrameBuffer(AsyncLcd &lcd)
+  : _lcd(lcd), _cursorRow(0), _cursorCol(LCD_WIDTH), _bytesSentBeforeUpdate(0),
+    _isUpdateSending(false), _errorCount(0) {
+  memset(_cells, ' ', sizeof(_cells));
+}
+
+void LcdFrameBuffer::clear() {
+  _lcd.clear();
+  memset(_cells, ' ', sizeof(_cells));
+  // clear() also homes the cursor
+  _cursorRow = 0;
+  _cursorCol = 0;
+}
+
+boolean LcdFrameBuffer::update(const char *line1, const char *line2) {
+  unsigned long bytesSent = _lcd.bytesSent();
+  boolean isRedrawn = isStale();
+  if (isRedrawn) {
+    // Initialisation clears the display, so all the text is then redrawn
+    _errorCount = _lcd.errorCount();
+    _lcd.reinitialise();
+    memset(_cells, ' ', sizeof(_cells));
+    _cursorRow = 0;
+    _cursorCol = 0;
+  }
+  unsigned int lcdBytes = updateRow(0, line1) + updateRow(1, line2);
+  if ((isRedrawn || lcdBytes != 0) && !_isUpdateSending) {
+    _bytesSentBeforeUpdate = bytesSent;
+    _isUpdateSending = true;
+  }
+  return lcdBytes != 0;
+}
+
+boolean LcdFrameBuffer::takeUpdateI2CBytes(unsigned long &bytes) {
+  if (!_isUpdateSending || _lcd.isBusy()) {
+    return false;
+  }
+  bytes = _lcd.bytesSent() - _bytesSentBeforeUpdate;
+  _isUpdateSending = false;
+  return true;
+}
+
+// Writes changed cells of the given row and returns the number of bytes sent to
+// the HD44780
+unsigned int LcdFrameBuffer::updateRow(byte row, const char *text) {
+  int length = strlen(text);
+  if (length > LCD_WIDTH) {
+    length = LCD_WIDTH;
+  }
+  int left = (LCD_WIDTH - length) / 2;
+  unsigned int lcdBytes = 0;
+  for (int col = 0; col < LCD_WIDTH; col++) {
+    char c = (col >= left && col < left + length) ? text[col - left] : ' ';
+    if (_cells[row][col] == c) {
+      continue;
+    }
+    if (_cursorRow != row || _cursorCol != col) {
+      _lcd.setCursor(col, row);
+      _cursorRow = row;
+      lcdBytes++;
+    }
+    _lcd.write(c);
+    _cells[row][col] = c;
+    // HD44780 auto-increments the address, but it does not wrap from the end of
+    // one row to the start of the next: LCD_WIDTH marks cursor as off screen
+    _cursorCol = col + 1;
+    lcdBytes++;
+  }
+  return lcdBytes;
+}
@@ -0,0 +1,64 @@
+/*
+ * lcd_framebuffer.h
+ *
+ * Shadow copy of the characters currently shown on the LCD. New content is
+ * compared with the shadow cell by cell and only the cells that differ are
+ * sent to the display, along with any cursor moves needed to reach them. This
+ * avoids clearing and redrawing the whole display whenever any text changes.
+ */
+
+#ifndef _LCD_FRAMEBUFFER_H
+#define _LCD_FRAMEBUFFER_H
+
+#include <Arduino.h>
+#include "async_lcd.h"
+
+#define LCD_WIDTH   16
+#define LCD_HEIGHT   2
+
+class LcdFrameBuffer {
+
+  public:
+
+    LcdFrameBuffer(AsyncLcd &lcd);
+
+    // Clears the display and the shadow copy. Keeps the I2C bus busy for 2 ms:
+    // for use at start up only.
+    void clear();
+
+    // Displays the given lines, each centred on its row. Only cells that differ
+    // from what is already displayed are written, unless isStale(), when the
+    // display is initialised again & all are. Returns true if anything changed.
+    boolean update(const char *line1, const char *line2);
+
+    // True if writes to the LCD have been lost since the last update(), when a
+    // transmission failed, so the display must be initialised & redrawn
+    boolean isStale() const { return _lcd.errorCount() != _errorCount; }
+
+    // Gets the number of I2C bytes sent to the display, as counted by
+    // AsyncLcd, from the start of the first update() that changed it since the
+    // last call, so including any earlier writes still being sent then. The
+    // writes go out in the background, so the count is only complete once the
+    // bus is idle: returns true, once, when it is, or false if there's no
+    // update to report yet.
+    boolean takeUpdateI2CBytes(unsigned long &bytes);
+
+  private:
+
+    AsyncLcd &_lcd;
+    char _cells[LCD_HEIGHT][LCD_WIDTH];
+    // Position where the LCD will write the next character, or a column of
+    // LCD_WIDTH if the cursor is not known to be on a visible cell.
+    byte _cursorRow;
+    byte _cursorCol;
+    // AsyncLcd's count of bytes sent before the update being reported, which
+    // is still being sent if _isUpdateSending
+    unsigned long _bytesSentBeforeUpdate;
+    boolean _isUpdateSending;
+    // AsyncLcd's error count as of the last update()
+    unsigned int _errorCount;
+
+    unsigned int updateRow(byte row, const char *text);
+};
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * line_buffer.cpp
+ *
+ * Implementation of LineBuffer. See line_buffer.h.
+ */
+
+#include "line_buffer.h"
+
+LineBuffer::LineBuffer() {
+  clear();
+}
+
+size_t LineBuffer::write(uint8_t c) {
+  if (_length == LCD_WIDTH) {
+    return 0;
+  }
+  _text[_length++] = c;
+  _text[_length] = '\0';
+  return 1;
+}
+
+void LineBuffer::clear() {
+  _length = 0;
+  _text[0] = '\0';
+}
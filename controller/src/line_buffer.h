@@ -0,0 +1,35 @@
+/*
+ * line_buffer.h
+ *
+ * One line of text for the LCD, built up with the usual print() calls in a
+ * fixed size buffer, so that no String, and so no heap, is needed to format
+ * the display. Text beyond LCD_WIDTH characters is dropped.
+ */
+
+#ifndef _LINE_BUFFER_H
+#define _LINE_BUFFER_H
+
+#include <Arduino.h>
+#include "lcd_framebuffer.h"
+
+class LineBuffer : public Print {
+
+  public:
+
+    LineBuffer();
+
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+    // Text so far, always terminated
+    const char *c_str() const { return _text; }
+
+    void clear();
+
+  private:
+
+    char _text[LCD_WIDTH + 1];
+    byte _length;
+};
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * log.cpp
+ *
+ * Implementation of logText() and logRecord(). See log.h.
+ */
+
+#include "log.h"
+
+// Longest record: start, ID, time, arguments & checksum
+#define LOG_MAX_RECORD_SIZE   (3 + 5 * (1 + LOG_MAX_ARGS))
+
+// Formats are only linked in if logText() is used
+#define LOG_MESSAGE(name, format) static const char LOG_FORMAT_##name[] PROGMEM = format;
+#include "log_messages.def"
+#undef LOG_MESSAGE
+
+static const char * const LOG_FORMATS[] PROGMEM = {
+#define LOG_MESSAGE(name, format) LOG_FORMAT_##name,
+#include "log_messages.def"
+#undef LOG_MESSAGE
+};
+
+void logText(SerialLog &out, LogMessage id, byte argc, long arg1, long arg2, long arg3) {
+  const long args[LOG_MAX_ARGS] = {arg1, arg2, arg3};
+  byte argIndex = 0;
+  const char *p = (const char *) pgm_read_ptr(&LOG_FORMATS[id]);
+  char c;
+  while ((c = pgm_read_byte(p++)) != '\0') {
+    if (c != '%') {
+      out.write(c);
+    }
+    else if (pgm_read_byte(p) == '%') {
+      out.write('%');
+      p++;
+    }
+    else if (argIndex < argc) {
+      out.print(args[argIndex++]);
+    }
+  }
+  out.println();
+}
+
+// Appends a variable length integer to a record & returns the new length
+static byte appendVarint(byte *record, byte length, unsigned long value) {
+  while (value >= 0x80) {
+    record[length++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  record[length++] = value;
+  return length;
+}
+
+void logRecord(SerialLog &out, LogMessage id, byte argc, long arg1, long arg2, long arg3) {
+  const long args[LOG_MAX_ARGS] = {arg1, arg2, arg3};
+  byte record[LOG_MAX_RECORD_SIZE];
+  byte length = 0;
+  record[length++] = LOG_RECORD_START;
+  record[length++] = id;
+  length = appendVarint(record, length, millis());
+  for (byte i = 0; i < argc && i < LOG_MAX_ARGS; i++) {
+    // Zigzag: 0, -1, 1, -2 ... => 0, 1, 2, 3 ...
+    unsigned long zigzag = ((unsigned long) args[i] << 1) ^ (unsigned long) (args[i] >> 31);
+    length = appendVarint(record, length, zigzag);
+  }
+  byte checksum = 0;
+  for (byte i = 1; i < length; i++) {
+    checksum ^= record[i];
+  }
+  record[length++] = checksum;
+  out.writeRecord(record, length);
+}
@@ -0,0 +1,48 @@
+/*
+ * log.h
+ *
+ * Writes the messages listed in log_messages.def to a SerialLog, either as text
+ * or as compact binary records. Used via the DBGlog() macros in debug.h.
+ *
+ * A binary record is:
+ *
+ *   LOG_RECORD_START, message ID, millis(), arguments..., checksum
+ *
+ * millis() and the arguments are variable length integers: 7 bits per byte,
+ * least significant first, with the top bit set on all but the last byte.
+ * Arguments are zigzag encoded first so that small negative numbers are also
+ * short. The checksum is the XOR of the message ID and all following bytes.
+ * The number of arguments is the number of % placeholders in the message's
+ * format.
+ *
+ * Text written by other means can be mixed with records, since
+ * LOG_RECORD_START never appears in it. tools/log_decode converts a mixed
+ * stream back to text.
+ */
+
+#ifndef _LOG_H
+#define _LOG_H
+
+#include <Arduino.h>
+#include "serial_log.h"
+
+// ASCII record separator
+#define LOG_RECORD_START    0x1E
+
+// Most arguments a message can have
+#define LOG_MAX_ARGS        3
+
+enum LogMessage {
+#define LOG_MESSAGE(name, format) LOG_##name,
+#include "log_messages.def"
+#undef LOG_MESSAGE
+  LOG_MESSAGE_COUNT
+};
+
+// Writes a message as a line of text. Message formats are stored in flash.
+void logText(SerialLog &out, LogMessage id, byte argc, long arg1 = 0, long arg2 = 0, long arg3 = 0);
+
+// Writes a message as a binary record. No message text is stored in flash.
+void logRecord(SerialLog &out, LogMessage id, byte argc, long arg1 = 0, long arg2 = 0, long arg3 = 0);
+
+#endif
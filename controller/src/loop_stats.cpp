@@ -0,0 +1,72 @@
+/*
+ * loop_stats.cpp
+ *
+ * Implementation of LoopStats. See loop_stats.h.
+ */
+
+#include "loop_stats.h"
+
+LoopStats::LoopStats() : _max(0), _startTime(0) {
+  reset();
+}
+
+void LoopStats::start() {
+  _startTime = micros();
+}
+
+void LoopStats::stop() {
+  uint32_t time = micros() - _startTime;
+  if (time > _max) {
+    _max = time;
+  }
+  // Bucket is position of highest set bit
+  byte index = 0;
+  for (unsigned long t = time >> 1; t != 0 && index < LOOP_STATS_BUCKETS - 1; t >>= 1) {
+    index++;
+  }
+  if (_buckets[index] == 0xFFFF) {
+    // Halve all counts rather than overflow: keeps the shape of the histogram
+    for (byte i = 0; i < LOOP_STATS_BUCKETS; i++) {
+      _buckets[i] = (_buckets[i] + 1) / 2;
+    }
+  }
+  _buckets[index]++;
+}
+
+void LoopStats::reset() {
+  for (byte i = 0; i < LOOP_STATS_BUCKETS; i++) {
+    _buckets[i] = 0;
+  }
+  _max = 0;
+}
+
+unsigned long LoopStats::count() const {
+  unsigned long total = 0;
+  for (byte i = 0; i < LOOP_STATS_BUCKETS; i++) {
+    total += _buckets[i];
+  }
+  return total;
+}
+
+unsigned long LoopStats::percentile(byte percent) const {
+  unsigned long total = count();
+  if (total == 0) {
+    return 0;
+  }
+  // Number of passes allowed to be slower than the percentile
+  unsigned long slower = total * (100 - percent) / 100;
+  unsigned long seen = 0;
+  byte index = LOOP_STATS_BUCKETS;
+  do {
+    index--;
+    seen += _buckets[index];
+  } while (seen <= slower && index > 0);
+  if (index == LOOP_STATS_BUCKETS - 1) {
+    return _max;
+  }
+  return min(bucketStart(index + 1) - 1, _max);
+}
+
+unsigned long LoopStats::bucketStart(byte index) {
+  return index == 0 ? 0 : 1UL << index;
+}
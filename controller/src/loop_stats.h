@@ -0,0 +1,61 @@
+/*
+ * loop_stats.h
+ *
+ * Measures how long each pass of the main loop takes, excluding any time spent
+ * asleep. Times are counted in a histogram with power of 2 buckets: bucket 0
+ * counts times under 2 us and bucket n times from 2^n to 2^(n+1) - 1 us, with
+ * the last bucket also counting anything longer. The longest time is kept
+ * exactly, while percentiles are estimated from the histogram, so are only
+ * accurate to within a factor of 2.
+ *
+ * Uses 40 bytes of SRAM.
+ */
+
+#ifndef _LOOP_STATS_H
+#define _LOOP_STATS_H
+
+#include <Arduino.h>
+
+// Number of histogram buckets. The last one starts at 2^15 us = 32.8 ms.
+#define LOOP_STATS_BUCKETS    16
+
+class LoopStats {
+
+  public:
+
+    LoopStats();
+
+    // Call at start of work done by a pass of the loop
+    void start();
+
+    // Call at end of work done by a pass of the loop, before sleeping
+    void stop();
+
+    void reset();
+
+    // Number of passes timed since reset. May be less than the number of
+    // passes if the histogram has been rescaled, see stop().
+    unsigned long count() const;
+
+    // Longest pass since reset in us
+    unsigned long maxTime() const { return _max; }
+
+    // Estimate of the time in us that the given percentage of passes took no
+    // longer than: the top of the bucket the percentile falls in, or maxTime()
+    // if less
+    unsigned long percentile(byte percent) const;
+
+    byte bucketCount() const { return LOOP_STATS_BUCKETS; }
+    unsigned int bucket(byte index) const { return _buckets[index]; }
+
+    // Shortest time in us counted in the given bucket
+    static unsigned long bucketStart(byte index);
+
+  private:
+
+    unsigned int _buckets[LOOP_STATS_BUCKETS];
+    unsigned long _max;
+    unsigned long _startTime;
+};
+
+#endif
@@ -5,40 +5,71 @@
 // MIT License: https://cahamo.mit-license.org/
 
 #include <Arduino.h>
-#include <ezButton.h>
-#include <Wire.h>
-#include <LiquidCrystal_I2C.h>
 #include <Keypad.h>
 
 #define DEBUG
+// Debug messages are written as compact binary records if DEBUG_TOKENS is
+// defined, as it is by the nanoatmega328new_tokens env: see debug.h
 #include "debug.h"
 
-#define LCD_WIDTH   16
-#define LCD_HEIGHT   2
+#ifdef DEBUG
+// Destination of debug output
+SerialLog serialLog;
+#endif
+
+// Debug serial port baud rate
+#define DEBUG_BAUD_RATE       115200
+#include "async_lcd.h"
+#include "lcd_framebuffer.h"
+#include "line_buffer.h"
+#include "zone_monitor.h"
+#include "scheduler.h"
+#include "tick.h"
+#include "power.h"
+#include "pulse_engine.h"
+#include "fast_pin.h"
+#include "loop_stats.h"
+#include "eeprom_writer.h"
+#include "journal.h"
+#include "state_store.h"
+#include "reset_flags.h"
+#include "alarm_fsm.h"
+#include "suspend_entry.h"
+#include "battery_monitor.h"
 
 #define SECONDS_PER_MINUTE    60
 #define MILLIS_PER_SECOND     1000
 #define MILLIS_PER_MINUTE     ((unsigned long) MILLIS_PER_SECOND * SECONDS_PER_MINUTE)
 
-#define DEBOUNCE_DELAY        50
-
-#define MAGNET_SWITCH_PIN     2
 #define ALARM_LED_PIN         11
 #define ALARM_BUZZER_PIN      10
 #define HEARTBEAT_LED_PIN     12
 
-#define SUSPEND_OFF           0
-#define SUSPEND_INFINITE    (-1)
+// Compile time resolved access to the above pins. Reed switch pins are
+// accessed by zones, see zone_monitor.h.
+typedef FastPin<ALARM_LED_PIN> AlarmLEDPin;
+typedef FastPin<ALARM_BUZZER_PIN> AlarmBuzzerPin;
+typedef FastPin<HEARTBEAT_LED_PIN> HeartbeatLEDPin;
+
+// Whether gate has been opened, alarm is sounding & alarm is suspended
+AlarmFsm alarmFsm;
+
+// Start & length in ms of a timed suspension
+Tick suspendStartTime;
+long totalSuspendTime = 0;
 
-boolean alarmSounding = false;
-boolean gateOpen = false;
-unsigned long suspendStartTime = 0;
-long totalSuspendTime = SUSPEND_OFF;
+// Debounced inputs for the magnetic reed switch & parallel test button of each
+// gate, or zone, sampled by Timer1 interrupt
+ZoneMonitor zones;
 
-// create ezButton object for magnetic reed switch & parallel test button switch
-ezButton btnMagnet(MAGNET_SWITCH_PIN, INPUT);
+// Zones that have opened since the alarm was last reset. The alarm counts as
+// open, in alarmFsm, while any are.
+byte openedZones = 0;
 
-#define DIGIT_ENTRY_BASE 10
+#ifdef DEBUG
+// Zones last logged as open by traceZones()
+byte tracedZones = 0;
+#endif
 
 const byte KEYPAD_ROWS = 4;
 const byte KEYPAD_COLS = 3;
@@ -71,126 +102,334 @@ int keypadValue(char key) {
 
 Keypad keypad = Keypad(makeKeymap(keyPadKeys), rowPins, colPins, KEYPAD_ROWS, KEYPAD_COLS);
 
-long suspendTimeAccumulator = 0;
-boolean isUpdatingSuspendTime = false;
+SuspendEntry suspendEntry;
 
-LiquidCrystal_I2C lcd(0x27, LCD_WIDTH, LCD_HEIGHT);
+// Writes to LCD are sent in the background by the TWI interrupt
+AsyncLcd lcd(0x27);
+LcdFrameBuffer lcdFrameBuffer(lcd);
 
-unsigned long lastDisplayUpdate = 0;
-
-// Time between display refreshes in ms
+// Time between display refreshes in ms while a timed suspension is counting down.
+// Otherwise display is only refreshed when something changes.
 #define DISPLAY_UPDATE_DELTA      250
 
-// Time alarm buzzer sounds & is silent in ms
-#define ALARM_BUZZER_ON_TIME      1500
-#define ALARM_BUZZER_OFF_TIME     1000
-#define ALARM_BUZZER_CYCLE_TIME   (ALARM_BUZZER_ON_TIME + ALARM_BUZZER_OFF_TIME)
+// Patterns played on the alarm outputs: times in ms that each output is on &
+// off in turn, ending with 0, see pulse_engine.h
+
+// Alarm buzzer while alarm sounds
+const PulsePattern ALARM_BUZZER_PATTERN PROGMEM = {1500, 1000, 0};
+
+// Alarm LED while gate is open: flashes steadily for zone 1 & in groups of as
+// many flashes as the zone number for the others. Shows the lowest numbered
+// zone that's open.
+const PulsePattern ZONE_1_OPEN_PATTERN PROGMEM = {250, 250, 0};
+const PulsePattern ZONE_2_OPEN_PATTERN PROGMEM = {250, 250, 250, 1250, 0};
+const PulsePattern ZONE_3_OPEN_PATTERN PROGMEM = {250, 250, 250, 250, 250, 1250, 0};
+const PulsePattern ZONE_4_OPEN_PATTERN PROGMEM = {250, 250, 250, 250, 250, 250, 250, 1250, 0};
+const PulsePattern ZONE_5_OPEN_PATTERN PROGMEM = {250, 250, 250, 250, 250, 250, 250, 250, 250, 1250, 0};
 
-// Time alarm LED illuminates & is off in ms
-#define ALARM_LED_ON_TIME         250
-#define ALARM_LED_OFF_TIME        250
-#define ALARM_LED_CYCLE_TIME      (ALARM_LED_ON_TIME + ALARM_LED_OFF_TIME)
+const unsigned int *const ZONE_OPEN_PATTERNS[ZONE_COUNT] PROGMEM = {
+  ZONE_1_OPEN_PATTERN, ZONE_2_OPEN_PATTERN, ZONE_3_OPEN_PATTERN, ZONE_4_OPEN_PATTERN, ZONE_5_OPEN_PATTERN
+};
+
+// Heartbeat LED: a brief flash every few seconds normally & a triple flash when
+// the battery is low. While suspended it's held on, without a pattern.
+const PulsePattern HEARTBEAT_PATTERN PROGMEM = {100, 8000, 0};
+const PulsePattern LOW_BATTERY_PATTERN PROGMEM = {100, 200, 100, 200, 100, 2300, 0};
+
+// Interval between checks of battery in ms
+#define BATTERY_CHECK_INTERVAL    60000UL
 
-// Time heartbeat LED illuminates & is off in ms
-#define HEARTBEAT_LED_ON_TIME     100
-#define HEARTBEAT_LED_OFF_TIME    8000
-#define HEARTBEAT_LED_CYCLE_TIME  (HEARTBEAT_LED_ON_TIME + HEARTBEAT_LED_OFF_TIME)
+// Supply voltages in mV below which the battery is reported low & above which
+// it's reported OK again. The ATmega328P is only rated for 16 MHz down to about
+// 3.8 V.
+#define BATTERY_LOW_VOLTAGE       4300
+#define BATTERY_OK_VOLTAGE        4500
 
 // Time LED backlight stays on in ms
 #define LCD_BACKLIGHT_TIMEOUT     10000
 
-// Variables used to determine pulsing of alarm buzzer & LEDs
-unsigned long alarmBuzzerPulseStartTime = 0;
-unsigned long alarmLEDPulseStartTime = 0;
-unsigned long heartbeatLEDPulseStartTime = millis();
-unsigned long lcdBacklightTimeoutStartTime = 0;
-// bool isLcdBacklightOn = true;
+// Interval between keypad scans in ms while keypad is in use, and time in ms
+// that keypad is deemed to be in use after it wakes the MCU or a key is read.
+// It's only scanned while in use.
+#define KEYPAD_SCAN_INTERVAL      10
+#define KEYPAD_ACTIVE_TIME        100
+
+// Time splash screen is shown at start up in ms, unless there's something else
+// to display
+#define SPLASH_SCREEN_TIME        2000
+
+// Longest sleep in ms while the LCD or EEPROM is still being written to
+#define BACKGROUND_BUSY_SLEEP_TIME  5
+
+// Interval between reports of time spent asleep in ms
+#define DUTY_CYCLE_REPORT_INTERVAL  60000UL
+
+// Alarm buzzer & LEDs are pulsed by Timer1 interrupt
+PulseEngine pulses;
+byte alarmBuzzerChannel;
+byte alarmLEDChannel;
+byte heartbeatLEDChannel;
+
+// Everything that happens at a given time, rather than in response to an input,
+// is done by one of these tasks, run by the scheduler when due
+Scheduler scheduler;
+
+// Time at the start of the current pass of loop(), or of setup(). It's read
+// once, so every decision made in a pass sees the same time.
+Tick loopTime;
+
+void suspensionTimeoutTask();
+void displayUpdateTask();
+void lcdBacklightTimeoutTask();
+void dutyCycleReportTask();
+void splashScreenTimeoutTask();
+void batteryCheckTask();
+
+TaskId suspensionTimeoutTaskId;
+TaskId displayUpdateTaskId;
+TaskId lcdBacklightTimeoutTaskId;
+TaskId dutyCycleReportTaskId;
+TaskId splashScreenTimeoutTaskId;
+TaskId batteryCheckTaskId;
+
+// Splash screen is shown in place of "OK" until this is cleared
+boolean isShowingSplashScreen = true;
+
+// Set once the gates have first been checked, when the time since start
+// up is reported. Timer0 is started by the Arduino core just before setup(), so
+// the time misses the C runtime's start up, which is well under 1 ms.
+boolean isArmed = false;
+
+// MCU sleeps between events, woken by inputs and by Timer0 or watchdog
+PowerSaver powerSaver;
+
+// Keypad is scanned frequently until this time, after having woken the MCU
+Tick keypadActiveUntil;
+
+// True while keypad columns are driven LOW, between periods of scanning
+boolean keypadColumnsDriven = false;
+
+// Time taken by the work done in each pass of the loop. Sent to the serial port
+// on receipt of LOOP_STATS_PRINT_COMMAND & cleared by LOOP_STATS_RESET_COMMAND.
+LoopStats loopStats;
+
+#define LOOP_STATS_PRINT_COMMAND  'l'
+#define LOOP_STATS_RESET_COMMAND  'r'
+
+// Gate & alarm events are recorded in EEPROM. Sent to serial port, a record at a
+// time, on receipt of JOURNAL_DUMP_COMMAND.
+EepromWriter eepromWriter;
+Journal journal(eepromWriter);
+
+// Most journal records queued by one pass of loop(): one for each zone if all
+// open at once, one for the alarm sounding & two for the event of a key, such
+// as reset ending both a suspension & an open gate. The state is saved at the
+// end of the pass too. All must fit in the EEPROM writer's queues, or records
+// are lost.
+#define JOURNAL_RECORDS_PER_PASS  (ZONE_COUNT + 1 + 2)
+
+static_assert(EEPROM_WRITER_QUEUE_SIZE >= JOURNAL_RECORDS_PER_PASS * sizeof(JournalRecord) + sizeof(SavedState),
+  "EEPROM writer queue must hold the records & saved state from a pass of loop()");
+static_assert(EEPROM_WRITER_JOBS >= JOURNAL_RECORDS_PER_PASS + 1,
+  "EEPROM writer must queue as many writes as a pass of loop() makes");
+
+#define JOURNAL_DUMP_COMMAND      'j'
+
+// Next journal record to dump & number of records in dump
+byte journalDumpIndex = 0;
+byte journalDumpCount = 0;
+
+// Space needed in serial buffer to dump a journal record
+#define JOURNAL_DUMP_SPACE        64
+
+// When things started, for durations recorded in journal
+Tick gateOpenTime;
+Tick alarmStartTime;
+Tick suspendedSince;
+
+// Gate, alarm & suspension state is saved in EEPROM whenever it changes &
+// restored at start up, so it survives a power cut
+StateStore stateStore(eepromWriter);
 
 void switchLCDBacklightOn() {
-  lcdBacklightTimeoutStartTime = millis();
   lcd.backlight();
+  scheduler.scheduleIn(lcdBacklightTimeoutTaskId, LCD_BACKLIGHT_TIMEOUT, loopTime);
 }
 
 void switchLCDBacklightOff() {
   lcd.noBacklight();
-  lcdBacklightTimeoutStartTime = 0;
+  scheduler.cancel(lcdBacklightTimeoutTaskId);
+}
+
+// Only the characters that differ from those already displayed are sent to the
+// LCD: the display is never cleared once set up. The first line is always
+// fixed text, so comes from flash.
+void writeLinesOnLCD(const __FlashStringHelper *line1, const char *line2) {
+  LineBuffer text;
+  text.print(line1);
+  if (lcdFrameBuffer.update(text.c_str(), line2)) {
+    switchLCDBacklightOn();
+  }
+}
+
+void writeLinesOnLCD(const __FlashStringHelper *line1, const __FlashStringHelper *line2) {
+  LineBuffer text;
+  text.print(line2);
+  writeLinesOnLCD(line1, text.c_str());
+}
+
+void requestDisplayUpdate() {
+  scheduler.scheduleIn(displayUpdateTaskId, 0, loopTime);
+}
+
+// Supply voltage is measured in the background every BATTERY_CHECK_INTERVAL ms
+BatteryMonitor batteryMonitor;
+boolean isBatteryLow = false;
+boolean isMeasuringBattery = false;
+
+// What the heartbeat LED shows
+#define HEARTBEAT_NONE          0   // not yet started
+#define HEARTBEAT_NORMAL        1
+#define HEARTBEAT_SUSPENDED     2
+#define HEARTBEAT_LOW_BATTERY   3
+
+byte heartbeatMode = HEARTBEAT_NONE;
+
+// Heartbeat LED shows the alarm is working, whether it's suspended & whether
+// the battery is low, which takes priority. Must be called whenever suspension
+// or battery state may have changed. The LED is only changed if the mode has,
+// so that it keeps a steady rhythm through other events.
+void updateHeartbeat() {
+  byte mode;
+  if (isBatteryLow) {
+    mode = HEARTBEAT_LOW_BATTERY;
+  }
+  else if (alarmFsm.isSuspended()) {
+    mode = HEARTBEAT_SUSPENDED;
+  }
+  else {
+    mode = HEARTBEAT_NORMAL;
+  }
+  if (mode == heartbeatMode) {
+    return;
+  }
+  heartbeatMode = mode;
+  if (mode == HEARTBEAT_LOW_BATTERY) {
+    pulses.start(heartbeatLEDChannel, LOW_BATTERY_PATTERN);
+  }
+  else if (mode == HEARTBEAT_SUSPENDED) {
+    pulses.set(heartbeatLEDChannel, HIGH);
+  }
+  else {
+    pulses.start(heartbeatLEDChannel, HEARTBEAT_PATTERN);
+  }
 }
 
+// Defined below, once the functions they use are
+void restoreState();
+void resumeState();
+unsigned long suspendMillisLeft();
+
 void setup() {
 
+  loopTime = Tick::now();
+
   // Enable serial port iff DEBUG is defined
-  DBGbegin(9600);
+  DBGbegin(DEBUG_BAUD_RATE);
 
-  // Setup LCD
-  lcd.init();
-  lcd.clear();
-  lcd.backlight();
+  // Start watching the gates straight away. Changes are debounced by the
+  // Timer1 interrupt, once started below.
+  zones.begin();
 
-  // Display splash screen
-  lcd.setCursor(0, 0);
-  lcd.print(F("** Gate Alarm **"));
-  lcd.setCursor(0, 1);
-  lcd.print(F("**   Welcome  **"));
-  switchLCDBacklightOn();
-  delay(2000);
+  // Find end of journal & record why MCU was reset
+  journal.begin();
+  journal.record(JOURNAL_BOOT, resetFlags);
 
-  // Set up debounce time for magnet switch & parallel test button
-  btnMagnet.setDebounceTime(DEBOUNCE_DELAY);
+  // Pick up where we left off if reset while gate open or alarm suspended
+  restoreState();
 
-  // Set up alarm pins & ensure all off
-  pinMode(ALARM_LED_PIN, OUTPUT);
-  pinMode(ALARM_BUZZER_PIN, OUTPUT);
-  pinMode(HEARTBEAT_LED_PIN, OUTPUT);
-}
+  // Register timed tasks: none are run until scheduled
+  suspensionTimeoutTaskId = scheduler.add(suspensionTimeoutTask);
+  displayUpdateTaskId = scheduler.add(displayUpdateTask);
+  lcdBacklightTimeoutTaskId = scheduler.add(lcdBacklightTimeoutTask);
+  dutyCycleReportTaskId = scheduler.add(dutyCycleReportTask);
+  splashScreenTimeoutTaskId = scheduler.add(splashScreenTimeoutTask);
+  batteryCheckTaskId = scheduler.add(batteryCheckTask);
 
-boolean isSuspended() {
-  return totalSuspendTime != SUSPEND_OFF;
-}
+  // Setup LCD: done in the background, as is everything written to it
+  lcd.begin();
+  lcdFrameBuffer.clear();
 
-boolean isInfiniteSuspension() {
-  return totalSuspendTime == SUSPEND_INFINITE;
-}
-
-void writeLinesOnLCD(String line1, String line2) {
-  static String oldLine1 = "";
-  static String oldLine2 = "";
-  if ( (line1 != oldLine1) || (line2 != oldLine2)) {
-    switchLCDBacklightOn();
-    oldLine1 = line1;
-    oldLine2 = line2;
-    lcd.clear();
-    int leftLine1 = ((LCD_WIDTH) - line1.length()) / 2;
-    lcd.setCursor(leftLine1, 0);
-    lcd.print(line1);
-    int leftLine2 = ((LCD_WIDTH) - line2.length()) / 2;
-    lcd.setCursor(leftLine2, 1);
-    lcd.print(line2);
+  // Set up alarm pins & ensure all off
+  AlarmLEDPin::output();
+  AlarmBuzzerPin::output();
+  HeartbeatLEDPin::output();
+  alarmLEDChannel = pulses.addOutput(AlarmLEDPin::write);
+  alarmBuzzerChannel = pulses.addOutput(AlarmBuzzerPin::write);
+  heartbeatLEDChannel = pulses.addOutput(HeartbeatLEDPin::write);
+  pulses.begin();
+  resumeState();
+
+  // Reed switches & keypad rows wake MCU from sleep. The keypad library only
+  // pulls up the rows when it scans them, so do it here too, as they're first
+  // scanned after a key wakes the MCU.
+  for (byte i = 0; i < ZONE_COUNT; i++) {
+    powerSaver.addWakePin(ZoneMonitor::PINS[i]);
   }
+  for (byte i = 0; i < KEYPAD_ROWS; i++) {
+    pinMode(rowPins[i], INPUT_PULLUP);
+    powerSaver.addWakePin(rowPins[i]);
+  }
+#ifdef DEBUG
+  // The UART stops in power-down, so wake on the serial RX pin. The character
+  // that wakes the MCU is lost, but it then stays awake long enough to receive
+  // a repeat of it.
+  powerSaver.addWakePin(0);
+#endif
+
+  // Start periodic tasks. First display update shows splash screen.
+  requestDisplayUpdate();
+  scheduler.scheduleIn(splashScreenTimeoutTaskId, SPLASH_SCREEN_TIME, loopTime);
+  updateHeartbeat();
+  powerSaver.resetStats();
+  scheduler.scheduleIn(dutyCycleReportTaskId, DUTY_CYCLE_REPORT_INTERVAL, loopTime);
+  scheduler.scheduleIn(batteryCheckTaskId, 0, loopTime);
 }
 
 void updateDisplay() {
-  if (isUpdatingSuspendTime) {
-    writeLinesOnLCD(F("Enter delay:"), String(suspendTimeAccumulator));
+  LineBuffer line;
+  if (suspendEntry.isEntering()) {
+    line.print(suspendEntry.minutes());
+    writeLinesOnLCD(F("Enter delay:"), line.c_str());
   }
-  else if (isSuspended()) {
-    if (isInfiniteSuspension()) {
+  else if (alarmFsm.isSuspended()) {
+    if (alarmFsm.isSuspendedForever()) {
       writeLinesOnLCD(F("Alarm"), F("Suspended"));
     }
     else {
-      long millisRemaining = totalSuspendTime - millis() + suspendStartTime;
+      unsigned long millisRemaining = suspendMillisLeft();
       unsigned int minsRemaining = millisRemaining / MILLIS_PER_MINUTE;
       unsigned int secsRemaining = (millisRemaining - minsRemaining * MILLIS_PER_MINUTE) / MILLIS_PER_SECOND;
       secsRemaining %= SECONDS_PER_MINUTE;
-      String secsStr = String(secsRemaining);
-      if (secsStr.length() == 1) {
-        secsStr = "0" + secsStr;
-      }
-      writeLinesOnLCD(F("Alarm paused for"), String(minsRemaining) + F(":") + String(secsStr));
+      line.print(minsRemaining);
+      line.print(secsRemaining < 10 ? F(":0") : F(":"));
+      line.print(secsRemaining);
+      writeLinesOnLCD(F("Alarm paused for"), line.c_str());
     }
   }
   else {
-    if (gateOpen) {
-      writeLinesOnLCD(F("** GATE **"), F("** OPEN **"));
+    if (alarmFsm.isGateOpen()) {
+      line.print(F("OPEN:"));
+      for (byte i = 0; i < ZONE_COUNT; i++) {
+        if (openedZones & _BV(i)) {
+          line.print(' ');
+          line.print(i + 1);
+        }
+      }
+      writeLinesOnLCD(F("** GATE **"), line.c_str());
+    }
+    else if (isShowingSplashScreen) {
+      writeLinesOnLCD(F("** Gate Alarm **"), F("**   Welcome  **"));
     }
     else {
       writeLinesOnLCD(F("OK"), "");
@@ -198,142 +437,447 @@ void updateDisplay() {
   }
 }
 
+// Alarm LED is pulsed while gate is open, regardless of whether suspended or not
 void hideAlarmLED() {
-  alarmLEDPulseStartTime = 0;
-  digitalWrite(ALARM_LED_PIN, LOW);
+  pulses.set(alarmLEDChannel, LOW);
 }
 
+// Shows the lowest numbered zone that has opened
 void showAlarmLED() {
-  digitalWrite(ALARM_LED_PIN, HIGH);
-  alarmLEDPulseStartTime = millis();
+  byte zone = 0;
+  while (zone < ZONE_COUNT - 1 && !(openedZones & _BV(zone))) {
+    zone++;
+  }
+  pulses.start(alarmLEDChannel, (const unsigned int *) pgm_read_ptr(&ZONE_OPEN_PATTERNS[zone]));
 }
 
-void silenceAlarm() {
-  if (alarmSounding) {
-    alarmSounding = false;
-    alarmBuzzerPulseStartTime = 0;
-    digitalWrite(ALARM_BUZZER_PIN, LOW);
-    DBGprintln(F("*** Alarm silenced"));
+// Logs a change in the zones that are open, after debouncing, as an input for
+// tools/replay. Keys are logged as they're read.
+void traceZones() {
+#ifdef DEBUG
+  byte open = zones.openZones();
+  if (open != tracedZones) {
+    tracedZones = open;
+    DBGlog2(INPUT_ZONES, loopTime.ms(), open);
   }
+#endif
 }
 
-void activateAlarm() {
-  if (gateOpen) {
-    if (!alarmSounding) {
-      DBGprintln(F("*** ALARM ACTIVATED"));
-      digitalWrite(ALARM_BUZZER_PIN, HIGH);
-      alarmBuzzerPulseStartTime = millis();
-      alarmSounding = true;
+// Records zones that have just opened. The gate open event follows.
+void openZones(byte opened) {
+  for (byte i = 0; i < ZONE_COUNT; i++) {
+    if (opened & ~openedZones & _BV(i)) {
+      DBGlog1(ZONE_OPENED, i + 1);
+      journal.record(JOURNAL_GATE_OPENED, i + 1);
     }
   }
+  byte wasOpened = openedZones;
+  openedZones |= opened;
+  // Alarm LED may now need to show a lower numbered zone
+  if (alarmFsm.isGateOpen() && openedZones != wasOpened) {
+    showAlarmLED();
+  }
 }
 
-void cancelSuspension() {
-  totalSuspendTime = SUSPEND_OFF;
-  suspendStartTime = 0;
+void soundAlarm() {
+  DBGlog(ALARM_ACTIVATED);
+  journal.record(JOURNAL_ALARM_ACTIVATED, 0);
+  alarmStartTime = loopTime;
+  pulses.start(alarmBuzzerChannel, ALARM_BUZZER_PATTERN);
 }
 
-void openGate() {
-  if (!gateOpen) {
-    DBGprintln(F("*** Gate open"));
-    gateOpen = true;
-    showAlarmLED();
-    if (! isSuspended() ) {
-      activateAlarm();
-    }
+void silenceAlarm() {
+  pulses.set(alarmBuzzerChannel, LOW);
+  journal.record(JOURNAL_ALARM_SILENCED, loopTime.since(alarmStartTime));
+  DBGlog(ALARM_SILENCED);
+}
+
+// Schedules check for end of a timed suspension. A suspension times out once
+// more than totalSuspendTime ms have passed since it started.
+void scheduleSuspensionTimeout() {
+  scheduler.scheduleIn(suspensionTimeoutTaskId, suspendMillisLeft() + 1, loopTime);
+}
+
+// Starts suspension for totalSuspendTime ms, or indefinitely if event is
+// EVENT_SUSPEND_FOREVER. Replaces any suspension already running.
+void startSuspension(byte event) {
+  suspendedSince = loopTime;
+  if (event == EVENT_SUSPEND_FOREVER) {
+    DBGlog1(RESULT_SUSPENDED, -1);
+    journal.record(JOURNAL_SUSPENDED, JOURNAL_FOREVER);
+    scheduler.cancel(suspensionTimeoutTaskId);
+  }
+  else {
+    DBGlog1(RESULT_SUSPENDED, totalSuspendTime);
+    journal.record(JOURNAL_SUSPENDED, totalSuspendTime);
+    suspendStartTime = loopTime;
+    scheduleSuspensionTimeout();
   }
 }
 
-void reset() {
-  DBGprintln(F("*** Reset"));
-  gateOpen = false;
-  cancelSuspension();
-  silenceAlarm();
+void endSuspension() {
+  journal.record(JOURNAL_SUSPENSION_ENDED, loopTime.since(suspendedSince));
+  scheduler.cancel(suspensionTimeoutTaskId);
+}
+
+void openGate() {
+  DBGlog(GATE_OPEN);
+  gateOpenTime = loopTime;
+  showAlarmLED();
+}
+
+// Gate is deemed closed
+void reset(boolean wasOpen) {
+  DBGlog(RESET);
+  journal.record(JOURNAL_RESET, wasOpen ? loopTime.since(gateOpenTime) : 0);
+  openedZones = 0;
   hideAlarmLED();
 }
 
+// Moves alarm state machine on for an event & carries out the actions of the
+// transition
+void handleEvent(byte event) {
+  byte previous = alarmFsm.state();
+  boolean wasGateOpen = alarmFsm.isGateOpen();
+  byte actions = alarmFsm.dispatch(event);
+  if (actions == ACTION_ILLEGAL) {
+    DBGlog2(ILLEGAL_EVENT, event, previous);
+    return;
+  }
+  if (actions & ACTION_RESET) {
+    reset(wasGateOpen);
+  }
+  if (actions & ACTION_END_SUSPENSION) {
+    endSuspension();
+  }
+  if (actions & ACTION_START_SUSPENSION) {
+    startSuspension(event);
+  }
+  if (actions & ACTION_SILENCE_ALARM) {
+    silenceAlarm();
+  }
+  if (actions & ACTION_OPEN_GATE) {
+    openGate();
+  }
+  if (actions & ACTION_SOUND_ALARM) {
+    soundAlarm();
+  }
+  updateHeartbeat();
+}
+
+// Time left of a timed suspension in ms. 0 once it's due to time out, even if
+// the timeout task hasn't run yet.
+unsigned long suspendMillisLeft() {
+  unsigned long elapsed = loopTime.since(suspendStartTime);
+  if (elapsed >= (unsigned long) totalSuspendTime) {
+    return 0;
+  }
+  return totalSuspendTime - elapsed;
+}
+
+// Minutes left of a timed suspension, rounded up
+unsigned int suspendMinutesLeft() {
+  return (suspendMillisLeft() + MILLIS_PER_MINUTE - 1) / MILLIS_PER_MINUTE;
+}
+
+// Saves state if it has changed. While a timed suspension counts down this is
+// once a minute.
+void saveState() {
+  SavedState state;
+  state.gateOpen = alarmFsm.isGateOpen();
+  state.alarmSounding = alarmFsm.isAlarmSounding();
+  state.openZones = openedZones;
+  state.suspendMinutesLeft = 0;
+  if (!alarmFsm.isSuspended()) {
+    state.suspension = SAVED_NOT_SUSPENDED;
+  }
+  else if (alarmFsm.isSuspendedForever()) {
+    state.suspension = SAVED_SUSPENDED_FOREVER;
+  }
+  else {
+    state.suspension = SAVED_SUSPENDED_TIMED;
+    state.suspendMinutesLeft = suspendMinutesLeft();
+  }
+  stateStore.save(state);
+}
+
+// Restores state saved before the MCU was reset. There's no way to tell how
+// long the power was off, so a timed suspension resumes with the time that was
+// left when last saved, less the part minute that may have passed since then.
+// If that leaves no time the suspension has ended & the alarm sounds if the
+// gate is open.
+void restoreState() {
+  SavedState saved;
+  if (!stateStore.begin(saved)) {
+    return;
+  }
+  byte state = saved.gateOpen ? STATE_ALARM : STATE_ARMED;
+  if (saved.suspension == SAVED_SUSPENDED_FOREVER) {
+    state = saved.gateOpen ? STATE_SUSPENDED_FOREVER_OPEN : STATE_SUSPENDED_FOREVER;
+  }
+  else if (saved.suspension == SAVED_SUSPENDED_TIMED && saved.suspendMinutesLeft > 1) {
+    state = saved.gateOpen ? STATE_SUSPENDED_OPEN : STATE_SUSPENDED;
+    totalSuspendTime = (long) (saved.suspendMinutesLeft - 1) * MILLIS_PER_MINUTE;
+    suspendStartTime = loopTime;
+  }
+  alarmFsm.restore(state);
+  // Copies saved before there were zones don't say which was open
+  if (saved.gateOpen) {
+    openedZones = saved.openZones ? saved.openZones : 1;
+  }
+  DBGlog3(STATE_RESTORED, alarmFsm.isGateOpen(), alarmFsm.isAlarmSounding(),
+    alarmFsm.isSuspendedForever() ? -1 : alarmFsm.isSuspended() ? totalSuspendTime : 0);
+}
+
+// Starts the outputs & timers for restored state, once they're set up
+void resumeState() {
+  gateOpenTime = alarmStartTime = suspendedSince = loopTime;
+  if (alarmFsm.isGateOpen()) {
+    showAlarmLED();
+  }
+  if (alarmFsm.isAlarmSounding()) {
+    pulses.start(alarmBuzzerChannel, ALARM_BUZZER_PATTERN);
+  }
+  if (alarmFsm.isSuspended() && !alarmFsm.isSuspendedForever()) {
+    scheduleSuspensionTimeout();
+  }
+}
+
 void processKeypadDigit(int digit) {
-  DBGprint(F("Processing keypad DIGIT: "));
-  DBGprintln(digit);
-  if (isUpdatingSuspendTime) {
-    suspendTimeAccumulator = suspendTimeAccumulator * DIGIT_ENTRY_BASE + digit;
-    DBGprint(F("  Editing suspend time. Updated value = "));
-    DBGprintln(suspendTimeAccumulator);
+  DBGlog1(KEYPAD_DIGIT, digit);
+  if (suspendEntry.isEntering()) {
+    if (suspendEntry.addDigit(digit)) {
+      DBGlog1(SUSPEND_TIME_UPDATED, suspendEntry.minutes());
+    }
   }
   else {
-    suspendTimeAccumulator = digit;
-    isUpdatingSuspendTime = true;
-    DBGprint(F("  Starting to edit suspend time. Starting value = "));
-    DBGprintln(suspendTimeAccumulator);
+    suspendEntry.addDigit(digit);
+    DBGlog1(SUSPEND_TIME_STARTED, suspendEntry.minutes());
   }
 }
 
 void processKeypadHash() {
-  DBGprintln(F("Processing keypad HASH key"));
-  if (isUpdatingSuspendTime) {
-    if (suspendTimeAccumulator != 0) {
-      totalSuspendTime = suspendTimeAccumulator * MILLIS_PER_MINUTE;
-      DBGprint(F("  Entered suspend time of "));
-      DBGprintln(totalSuspendTime);
+  DBGlog(KEYPAD_HASH);
+  byte event = suspendEntry.finish();
+  if (event == EVENT_SUSPEND) {
+    totalSuspendTime = (long) suspendEntry.minutes() * MILLIS_PER_MINUTE;
+    DBGlog1(SUSPEND_TIME_ENTERED, totalSuspendTime);
+    handleEvent(EVENT_SUSPEND);
+  }
+  else if (event == EVENT_RESUME) {
+    DBGlog(SUSPEND_TIME_ZERO);
+    handleEvent(EVENT_RESUME);
+    if (alarmFsm.isGateOpen()) {
+      DBGlog(RESULT_ALARM_REACTIVATED);
     }
     else {
-      totalSuspendTime = SUSPEND_OFF;
-      DBGprintln(F("  Entered zero value for suspend time => turned suspension off"));
+      DBGlog(RESULT_NOT_SUSPENDED);
     }
-    suspendTimeAccumulator = 0;
-    isUpdatingSuspendTime = false;
   }
   else {
     // Hash button pressed on its own pauses alarm indefinately
-    totalSuspendTime = SUSPEND_INFINITE;
     switchLCDBacklightOn(); // re-activates backlight if off and # key pressed twice in a row
-    DBGprintln(F("  Pressed HASH key without entering value: entered infinite supension"));
+    DBGlog(SUSPEND_INFINITE);
+    handleEvent(EVENT_SUSPEND_FOREVER);
   }
+}
 
-  DBGprint(F("  Result: "));
-  if (isSuspended()) {
-    DBGprint(F("Suspended, time in ms = "));
-    DBGprintln(totalSuspendTime);
-    if (alarmSounding) {
-      silenceAlarm();
-    }
-    if (! isInfiniteSuspension() ) {
-      suspendStartTime = millis();
+void processKeypadStar() {
+  DBGlog(KEYPAD_STAR);
+  handleEvent(EVENT_RESET);
+}
+
+boolean isKeypadActive(Tick now) {
+  return keypad.getState() != IDLE || keypadActiveUntil.isAfter(now);
+}
+
+// While the keypad isn't being scanned its columns are all driven LOW, so that
+// pressing any key pulls its row LOW, which triggers the rows' pin change
+// interrupt & wakes the MCU. Scanning drives one column at a time, so needs
+// them released.
+void driveKeypadColumns(boolean drive) {
+  if (drive == keypadColumnsDriven) {
+    return;
+  }
+  keypadColumnsDriven = drive;
+  for (byte i = 0; i < KEYPAD_COLS; i++) {
+    if (drive) {
+      pinMode(colPins[i], OUTPUT);
+      digitalWrite(colPins[i], LOW);
     }
     else {
-      suspendStartTime = 0;
+      pinMode(colPins[i], INPUT);
     }
   }
-  else {
-    DBGprint(F("Not suspended, "));
-    if (gateOpen) {
-      DBGprintln(F("gate IS open (reactivating alarm)"));
-      activateAlarm();
+}
+
+// Returns true while the LCD or EEPROM is being written, or the journal is
+// being dumped
+boolean isBackgroundBusy() {
+  return lcd.isBusy() || eepromWriter.isBusy() || journalDumpIndex < journalDumpCount;
+}
+
+// Sleep is timed from the current time rather than loopTime, as the work done
+// in the pass has used some of it
+void sleepUntilNextEvent() {
+  Tick now = Tick::now();
+  unsigned long sleepTime = min(scheduler.timeToNextDeadline(now), zones.timeToSettle());
+  if (isKeypadActive(now)) {
+    sleepTime = min(sleepTime, (unsigned long) KEYPAD_SCAN_INTERVAL);
+  }
+  // I2C & EEPROM interrupts can't wake the MCU from power-down, so idle until
+  // they're done & then check again
+  if (isBackgroundBusy()) {
+    sleepTime = min(sleepTime, (unsigned long) BACKGROUND_BUSY_SLEEP_TIME);
+  }
+  if (sleepTime == 0) {
+    return;
+  }
+  // Power-down stops Timer0, so only use it when nothing is being timed
+  // precisely
+  boolean allowPowerDown = !alarmFsm.isGateOpen()
+    && (!alarmFsm.isSuspended() || alarmFsm.isSuspendedForever())
+    && !suspendEntry.isEntering()
+    && !isKeypadActive(now)
+    && !zones.isSettling()
+    && !isBackgroundBusy();
+  if (allowPowerDown) {
+    // Serial port stops in power-down
+    DBGflush();
+    // Timer1 also stops, so pulses are timed by the watchdog: don't oversleep
+    // the next change
+    sleepTime = min(sleepTime, pulses.timeToNextChange());
+  }
+  if (!isKeypadActive(now)) {
+    driveKeypadColumns(true);
+  }
+  boolean woken = powerSaver.sleep(sleepTime, allowPowerDown);
+  pulses.advance(powerSaver.lastPowerDownTime());
+  if (woken) {
+    keypadActiveUntil = Tick::now().after(KEYPAD_ACTIVE_TIME);
+  }
+}
+
+void printLoopStats() {
+  DBGlog3(LOOP_STATS, loopStats.count(), loopStats.maxTime(), loopStats.percentile(99));
+  for (byte i = 0; i < loopStats.bucketCount(); i++) {
+    if (loopStats.bucket(i) == 0) {
+      continue;
     }
-    else {
-      DBGprintln(F("gate NOT open (doing nothing)"));
+    DBGlog2(LOOP_STATS_BUCKET, LoopStats::bucketStart(i), loopStats.bucket(i));
+  }
+  DBGlog1(LOG_DROPPED, serialLog.dropped());
+}
+
+void processSerialCommands() {
+  int command;
+  while ((command = DBGread()) >= 0) {
+    if (command == LOOP_STATS_PRINT_COMMAND) {
+      printLoopStats();
+    }
+    else if (command == LOOP_STATS_RESET_COMMAND) {
+      loopStats.reset();
+    }
+    else if (command == JOURNAL_DUMP_COMMAND) {
+      DBGlog2(JOURNAL_SUMMARY, journal.count(), journal.lostCount());
+      journalDumpIndex = 0;
+      journalDumpCount = journal.count();
     }
   }
 }
 
-void processKeypadStar() {
-  DBGprintln(F("Processing keypad STAR key: resetting gate alarm"));
-  reset();
+void printJournalRecord(byte index) {
+  JournalRecord record;
+  if (!journal.read(index, record)) {
+    DBGlog1(JOURNAL_ENTRY_INVALID, index);
+    return;
+  }
+  switch (record.event) {
+    case JOURNAL_BOOT:
+      DBGlog3(JOURNAL_ENTRY_BOOT, record.sequence, record.time, record.duration);
+      break;
+    case JOURNAL_GATE_OPENED:
+      DBGlog3(JOURNAL_ENTRY_GATE_OPENED, record.sequence, record.time, record.duration);
+      break;
+    case JOURNAL_ALARM_ACTIVATED:
+      DBGlog2(JOURNAL_ENTRY_ALARM_ACTIVATED, record.sequence, record.time);
+      break;
+    case JOURNAL_ALARM_SILENCED:
+      DBGlog3(JOURNAL_ENTRY_ALARM_SILENCED, record.sequence, record.time, record.duration);
+      break;
+    case JOURNAL_SUSPENDED:
+      if (record.duration == JOURNAL_FOREVER) {
+        DBGlog2(JOURNAL_ENTRY_SUSPENDED_FOREVER, record.sequence, record.time);
+      }
+      else {
+        DBGlog3(JOURNAL_ENTRY_SUSPENDED, record.sequence, record.time, record.duration);
+      }
+      break;
+    case JOURNAL_SUSPENSION_ENDED:
+      DBGlog3(JOURNAL_ENTRY_SUSPENSION_ENDED, record.sequence, record.time, record.duration);
+      break;
+    case JOURNAL_RESET:
+      DBGlog3(JOURNAL_ENTRY_RESET, record.sequence, record.time, record.duration);
+      break;
+    default:
+      DBGlog3(JOURNAL_ENTRY_UNKNOWN, record.sequence, record.time, record.event);
+      break;
+  }
+}
+
+// Logs the I2C traffic of display updates once it has all been sent
+void logDisplayUpdate() {
+#ifdef DEBUG
+  unsigned long i2cBytes;
+  if (lcdFrameBuffer.takeUpdateI2CBytes(i2cBytes)) {
+    DBGlog1(LCD_UPDATED, i2cBytes);
+  }
+#endif
+}
+
+// Dumps as many journal records as there's room for in the serial buffer. Waits
+// until queued records have been written, so they're included.
+void continueJournalDump() {
+#ifdef DEBUG
+  while (
+    journalDumpIndex < journalDumpCount
+    && !eepromWriter.isBusy()
+    && serialLog.availableForWrite() >= JOURNAL_DUMP_SPACE
+  ) {
+    printJournalRecord(journalDumpIndex++);
+  }
+#endif
 }
 
 void loop() {
 
-  // MUST call the .loop() method for every ezButton each time round the loop
-  btnMagnet.loop();
+  loopStats.start();
+  loopTime = Tick::now();
 
-  // Gate is deemed to be open if either it really is or if test buton is pressed
-  if (btnMagnet.isPressed()) {
-    openGate();
+  // A gate is deemed to be open if either it really is or if its test button
+  // is pressed
+  byte opened = zones.takeOpened();
+  traceZones();
+  if (!isArmed) {
+    isArmed = true;
+    DBGlog1(TIME_TO_ARMED, micros());
+  }
+  if (opened) {
+    openZones(opened);
+    handleEvent(EVENT_GATE_OPENED);
+    requestDisplayUpdate();
   }
 
-  // Check if a key has been pressed on keypad: act on it if so
-  char keyPadKey = keypad.getKey();
+  // Check if a key has been pressed on keypad: act on it if so. Keypad is only
+  // scanned once a key has woken the MCU, until all keys are released.
+  char keyPadKey = NO_KEY;
+  if (isKeypadActive(loopTime)) {
+    driveKeypadColumns(false);
+    keyPadKey = keypad.getKey();
+  }
   if (keyPadKey) {
+    DBGlog2(INPUT_KEY, loopTime.ms(), keyPadKey);
+    keypadActiveUntil = loopTime.after(KEYPAD_ACTIVE_TIME);
     int keyVal = keypadValue(keyPadKey);
     if (keyVal >= 0 && keyVal <= 9) {
       processKeypadDigit(keyVal);
@@ -344,84 +888,114 @@ void loop() {
     else if (keyVal == STAR_KEY) {
       processKeypadStar();
     }
-
+    requestDisplayUpdate();
   }
 
-  // Check if any suspension has timed out
-  if (isSuspended() && ! isInfiniteSuspension()) {
-    if (millis() - suspendStartTime > (unsigned long) totalSuspendTime) {
-      DBGprintln(F("*** Suspension timeout"));
-      cancelSuspension();
-      activateAlarm();
-    }
+  // Initialise & redraw the display if a failed transmission left it in doubt
+  if (lcdFrameBuffer.isStale()) {
+    requestDisplayUpdate();
   }
 
-  // Display is updated every DISPLAY_UPDATE_DELTA ms
-  if (millis() - lastDisplayUpdate > DISPLAY_UPDATE_DELTA) {
-    updateDisplay();
-    lastDisplayUpdate = millis();
-  }
+  // Run any timed tasks that are due
+  scheduler.runDue(loopTime);
 
-  // Check if alarm is sounding and time take action if so
-  if (alarmSounding) {
-    if (millis() - alarmBuzzerPulseStartTime > ALARM_BUZZER_CYCLE_TIME) {
-      alarmBuzzerPulseStartTime = millis();
-    }
-    else {
-      if (millis() - alarmBuzzerPulseStartTime < ALARM_BUZZER_ON_TIME) {
-        digitalWrite(ALARM_BUZZER_PIN, HIGH);
-      }
-      else {
-        digitalWrite(ALARM_BUZZER_PIN, LOW);
-      }
-    }
-  }
+  processSerialCommands();
+  continueJournalDump();
+  logDisplayUpdate();
 
-  // Check if gate is open: Alarm LED is lit regardless of whether suspended or not
-  if (gateOpen) {
-    if (millis() - alarmLEDPulseStartTime > ALARM_LED_CYCLE_TIME) {
-      alarmLEDPulseStartTime = millis();
-    }
-    else {
-      if (millis() - alarmLEDPulseStartTime < ALARM_LED_ON_TIME) {
-        digitalWrite(ALARM_LED_PIN, HIGH);
-      }
-      else {
-        digitalWrite(ALARM_LED_PIN, LOW);
-      }
-    }
+  // Checkpoint any change of state to EEPROM
+  saveState();
+
+  // Time spent asleep isn't counted
+  loopStats.stop();
+
+  // Sleep until the next task is due or an input needs attention
+  sleepUntilNextEvent();
+
+}
+
+void suspensionTimeoutTask() {
+  if (loopTime.since(suspendStartTime) > (unsigned long) totalSuspendTime) {
+    DBGlog(SUSPENSION_TIMEOUT);
+    handleEvent(EVENT_SUSPENSION_TIMEOUT);
+    requestDisplayUpdate();
+  }
+  else {
+    // Long suspensions can exceed the scheduler's maximum delay
+    scheduleSuspensionTimeout();
   }
+}
 
-  // There's a heartbeat pulse every few seconds when a LED is flashed briefly
-  // unless the alarm is suspended in which case the LED is always lit
-  if (!isSuspended()) {
-    if (millis() - heartbeatLEDPulseStartTime > HEARTBEAT_LED_CYCLE_TIME) {
-      heartbeatLEDPulseStartTime = millis();
-    }
-    else {
-      if (millis() - heartbeatLEDPulseStartTime < HEARTBEAT_LED_ON_TIME) {
-        digitalWrite(HEARTBEAT_LED_PIN, HIGH);
-      }
-      else {
-        digitalWrite(HEARTBEAT_LED_PIN, LOW);
-      }
-    }
-  } else {
-    digitalWrite(HEARTBEAT_LED_PIN, HIGH);
+// Replaces splash screen with "OK", unless something else is already shown
+void splashScreenTimeoutTask() {
+  isShowingSplashScreen = false;
+  requestDisplayUpdate();
+}
+
+// Display is updated whenever requested and every DISPLAY_UPDATE_DELTA ms while
+// a timed suspension is counting down
+void displayUpdateTask() {
+  updateDisplay();
+  if (alarmFsm.isSuspended() && !alarmFsm.isSuspendedForever() && !suspendEntry.isEntering()) {
+    scheduler.scheduleIn(displayUpdateTaskId, DISPLAY_UPDATE_DELTA, loopTime);
   }
+}
 
-  // LCD backlight is normally switched off after it has been on for more than a few seconds
-  // EXCEPT:
-  //    * when gate is open
-  //    * when alarm paused for a fixed amount of time (but not when suspended indefinately)
-  //    * when user is entering a suspension time
+// LCD backlight is normally switched off after it has been on for more than a few seconds
+// EXCEPT:
+//    * when gate is open
+//    * when alarm paused for a fixed amount of time (but not when suspended indefinately)
+//    * when user is entering a suspension time
+void lcdBacklightTimeoutTask() {
   if (
-    (millis() - lcdBacklightTimeoutStartTime >= LCD_BACKLIGHT_TIMEOUT)
-    && !gateOpen
-    && (!isSuspended() || isInfiniteSuspension())
-    && !isUpdatingSuspendTime
+    !alarmFsm.isGateOpen()
+    && (!alarmFsm.isSuspended() || alarmFsm.isSuspendedForever())
+    && !suspendEntry.isEntering()
   ) {
     switchLCDBacklightOff();
   }
+  else {
+    // Check again later
+    scheduler.scheduleIn(lcdBacklightTimeoutTaskId, LCD_BACKLIGHT_TIMEOUT, loopTime);
+  }
+}
 
+// Reports percentage of time spent awake, in idle sleep & in power-down
+void dutyCycleReportTask() {
+#ifdef DEBUG
+  unsigned long elapsed = powerSaver.elapsedTime();
+  unsigned long idle = powerSaver.idleTime();
+  unsigned long powerDown = powerSaver.powerDownTime();
+  // Power-down time is an estimate, so may exceed elapsed time
+  unsigned long asleep = min(idle + powerDown, elapsed);
+  if (elapsed > 0) {
+    DBGlog3(DUTY_CYCLE, (elapsed - asleep) * 100 / elapsed, idle * 100 / elapsed, powerDown * 100 / elapsed);
+  }
+#endif
+  powerSaver.resetStats();
+  scheduler.repeatAfter(dutyCycleReportTaskId, DUTY_CYCLE_REPORT_INTERVAL);
+}
+
+// Measures supply voltage: first run starts measurement & second, once the ADC
+// has settled, finishes it
+void batteryCheckTask() {
+  if (!isMeasuringBattery) {
+    batteryMonitor.start();
+    isMeasuringBattery = true;
+    scheduler.scheduleIn(batteryCheckTaskId, BATTERY_MONITOR_SETTLE_TIME, loopTime);
+    return;
+  }
+  isMeasuringBattery = false;
+  unsigned int voltage = batteryMonitor.finish();
+  if (!isBatteryLow && voltage < BATTERY_LOW_VOLTAGE) {
+    isBatteryLow = true;
+    DBGlog1(BATTERY_LOW, voltage);
+    updateHeartbeat();
+  }
+  else if (isBatteryLow && voltage > BATTERY_OK_VOLTAGE) {
+    isBatteryLow = false;
+    DBGlog1(BATTERY_OK, voltage);
+    updateHeartbeat();
+  }
+  scheduler.scheduleIn(batteryCheckTaskId, BATTERY_CHECK_INTERVAL, loopTime);
 }
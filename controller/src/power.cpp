@@ -0,0 +1,193 @@
+/*
+ * power.cpp
+ *
+ * Implementation of PowerSaver. See power.h.
+ */
+
+#include "power.h"
+
+#ifdef __AVR__
+
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+
+// Maintained by Arduino core's Timer0 interrupt, see wiring.c
+extern volatile unsigned long timer0_millis;
+extern volatile unsigned long timer0_overflow_count;
+
+// Set by the pin change & watchdog interrupts respectively
+static volatile boolean wakePinChanged = false;
+static volatile boolean watchdogFired = false;
+
+ISR(PCINT0_vect) {
+  wakePinChanged = true;
+}
+
+ISR(PCINT1_vect) {
+  wakePinChanged = true;
+}
+
+ISR(PCINT2_vect) {
+  wakePinChanged = true;
+}
+
+ISR(WDT_vect) {
+  watchdogFired = true;
+}
+
+// Watchdog periods available for power-down, longest first. Times are the
+// nominal periods from the datasheet rather than the rounded names used by
+// avr-libc.
+struct WatchdogPeriod {
+  unsigned int millis;
+  byte prescaler;
+};
+
+static const WatchdogPeriod WATCHDOG_PERIODS[] = {
+  {1000, WDTO_1S}, {500, WDTO_500MS}, {250, WDTO_250MS}, {125, WDTO_120MS},
+  {64, WDTO_60MS}, {32, WDTO_30MS}, {16, WDTO_15MS}
+};
+
+// Starts the watchdog in interrupt only mode, i.e. without system reset
+static void startWatchdogInterrupt(byte prescaler) {
+  byte bits = (prescaler & 0x07) | ((prescaler & 0x08) ? _BV(WDP3) : 0);
+  MCUSR &= ~_BV(WDRF);
+  WDTCSR = _BV(WDCE) | _BV(WDE);
+  WDTCSR = _BV(WDIE) | bits;
+}
+
+// Moves millis() & micros() forward to account for time spent with Timer0
+// stopped
+static void advanceClock(unsigned long ms) {
+  byte oldSREG = SREG;
+  cli();
+  timer0_millis += ms;
+  // Timer0 overflows every 1.024 ms
+  timer0_overflow_count += ms * 125 / 128;
+  SREG = oldSREG;
+}
+
+void PowerSaver::addWakePin(byte pin) {
+  *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+  PCIFR |= _BV(digitalPinToPCICRbit(pin));
+  PCICR |= _BV(digitalPinToPCICRbit(pin));
+}
+
+boolean PowerSaver::sleep(unsigned long maxTime, boolean allowPowerDown) {
+  _lastPowerDownMillis = 0;
+  unsigned long start = millis();
+  if (allowPowerDown && maxTime >= POWER_DOWN_MIN_TIME) {
+    powerDown(maxTime);
+  }
+  unsigned long slept = millis() - start;
+  if (slept < maxTime) {
+    idle(maxTime - slept);
+  }
+  noInterrupts();
+  boolean woken = wakePinChanged;
+  wakePinChanged = false;
+  interrupts();
+  return woken;
+}
+
+void PowerSaver::idle(unsigned long maxTime) {
+  unsigned long start = millis();
+  unsigned long startMicros = micros();
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  // Any interrupt wakes the CPU, so keep going back to sleep until either time
+  // is up or a wake pin has changed
+  while (millis() - start < maxTime) {
+    cli();
+    if (wakePinChanged) {
+      sei();
+      break;
+    }
+    sleep_enable();
+    // Interrupts are not serviced until after the following instruction, so
+    // one can't arrive between the test above & going to sleep
+    sei();
+    sleep_cpu();
+    sleep_disable();
+  }
+  _idleMicros += micros() - startMicros;
+}
+
+void PowerSaver::powerDown(unsigned long maxTime) {
+  unsigned long slept = 0;
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  while (!wakePinChanged) {
+    const WatchdogPeriod *period = WATCHDOG_PERIODS;
+    const WatchdogPeriod *end = WATCHDOG_PERIODS + sizeof(WATCHDOG_PERIODS) / sizeof(WATCHDOG_PERIODS[0]);
+    while (period < end && (period->millis > maxTime - slept || period->millis > POWER_DOWN_MAX_PERIOD)) {
+      period++;
+    }
+    if (period == end) {
+      break;
+    }
+    watchdogFired = false;
+    cli();
+    wdt_reset();
+    startWatchdogInterrupt(period->prescaler);
+    if (!wakePinChanged) {
+      sleep_enable();
+      sleep_bod_disable();
+      sei();
+      sleep_cpu();
+      sleep_disable();
+    }
+    sei();
+    wdt_disable();
+    if (watchdogFired) {
+      slept += period->millis;
+    }
+    else {
+      // Woken by a pin change part way through the period: assume half of it
+      // had passed
+      slept += period->millis / 2;
+      break;
+    }
+  }
+  advanceClock(slept);
+  _powerDownMillis += slept;
+  _lastPowerDownMillis = slept;
+}
+
+#else
+
+#include "sim.h"
+
+// The simulator's clock and timers keep running through any sleep, so
+// lastPowerDownTime() is always 0. Time that would have been spent in
+// power-down is still counted in powerDownTime().
+
+void PowerSaver::addWakePin(byte pin) {
+  sim::enableWakePin(pin);
+}
+
+boolean PowerSaver::sleep(unsigned long maxTime, boolean allowPowerDown) {
+  _lastPowerDownMillis = 0;
+  unsigned long start = micros();
+  boolean woken = sim::sleep(maxTime);
+  uint32_t slept = micros() - start;
+  if (allowPowerDown && maxTime >= POWER_DOWN_MIN_TIME) {
+    _powerDownMillis += slept / 1000;
+  }
+  else {
+    _idleMicros += slept;
+  }
+  return woken;
+}
+
+#endif
+
+PowerSaver::PowerSaver() : _statsStartTime(), _idleMicros(0), _powerDownMillis(0), _lastPowerDownMillis(0) {}
+
+unsigned long PowerSaver::elapsedTime() const {
+  return Tick::now().since(_statsStartTime);
+}
+
+void PowerSaver::resetStats() {
+  _statsStartTime = Tick::now();
+  _idleMicros = 0;
+  _powerDownMillis = 0;
+}
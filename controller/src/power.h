@@ -0,0 +1,72 @@
+/*
+ * power.h
+ *
+ * Puts the ATmega328P to sleep while there is nothing to do.
+ *
+ * Idle mode stops only the CPU: timers keep running, so millis() stays accurate
+ * and the MCU is woken every ms by the Timer0 interrupt, after which it goes
+ * straight back to sleep unless time is up.
+ *
+ * Power-down mode stops all clocks, including Timer0. The watchdog timer is
+ * used to wake the MCU after a known period, which is then added to millis().
+ * The watchdog is only accurate to about 10%, and when woken early by a pin
+ * change the time slept can only be estimated, so power-down is only suitable
+ * when precise timing is not needed.
+ *
+ * In both modes the MCU is also woken by a change on any of the pins registered
+ * with addWakePin().
+ */
+
+#ifndef _POWER_H
+#define _POWER_H
+
+#include <Arduino.h>
+#include "tick.h"
+
+// Shortest time worth going into power-down for, in ms. This is the shortest
+// watchdog period.
+#define POWER_DOWN_MIN_TIME       16
+
+// Longest period of power-down sleep between watchdog wake ups, in ms. Limits
+// the error in millis() when woken early by a pin change.
+#define POWER_DOWN_MAX_PERIOD     1000
+
+class PowerSaver {
+
+  public:
+
+    PowerSaver();
+
+    // Enables the pin change interrupt on the given pin so that a change on it
+    // will end any sleep
+    void addWakePin(byte pin);
+
+    // Sleeps for up to maxTime ms, or until a wake pin changes. Power-down mode
+    // is used, as far as possible, iff allowPowerDown is true. Returns true if
+    // a wake pin has changed since the last call, in which case it doesn't
+    // sleep at all if the change was before the call, so none are missed.
+    boolean sleep(unsigned long maxTime, boolean allowPowerDown);
+
+    // Time in ms spent in power-down by the last call to sleep(). Timer1 & Timer2
+    // are stopped during power-down.
+    unsigned long lastPowerDownTime() const { return _lastPowerDownMillis; }
+
+    // Times in ms since stats were last reset. powerDownTime() is an estimate.
+    unsigned long elapsedTime() const;
+    unsigned long idleTime() const { return _idleMicros / 1000; }
+    unsigned long powerDownTime() const { return _powerDownMillis; }
+
+    void resetStats();
+
+  private:
+
+    Tick _statsStartTime;
+    unsigned long _idleMicros;
+    unsigned long _powerDownMillis;
+    unsigned long _lastPowerDownMillis;
+
+    void idle(unsigned long maxTime);
+    void powerDown(unsigned long maxTime);
+};
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * pulse_engine.cpp
+ *
+ * Implementation of PulseEngine. See pulse_engine.h.
+ */
+
+#include "pulse_engine.h"
+
+#ifndef __AVR__
+#include "sim.h"
+#endif
+
+// Timer1 runs at 16 MHz / 64 = 250 kHz, so 250 counts per ms
+#define TIMER1_COUNTS_PER_MS  250
+
+PulseEngine::Channel PulseEngine::_channels[PULSE_ENGINE_CHANNELS];
+byte PulseEngine::_channelCount = 0;
+void (*volatile PulseEngine::_tickHandler)() = NULL;
+
+#ifdef __AVR__
+ISR(TIMER1_COMPA_vect) {
+  PulseEngine::tick();
+}
+#endif
+
+PulseEngine::PulseEngine() {}
+
+byte PulseEngine::addOutput(PinWriter writer) {
+  Channel &channel = _channels[_channelCount];
+  channel.write = writer;
+  channel.level = LOW;
+  channel.remaining = 0;
+  writer(LOW);
+  return _channelCount++;
+}
+
+void PulseEngine::begin() {
+#ifdef __AVR__
+  noInterrupts();
+  // CTC mode, top = OCR1A, prescaler 64
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS11) | _BV(CS10);
+  TCNT1 = 0;
+  OCR1A = TIMER1_COUNTS_PER_MS - 1;
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 |= _BV(OCIE1A);
+  interrupts();
+#else
+  sim::attachTimer(timeToNextChange, advance);
+#endif
+}
+
+void PulseEngine::start(byte channel, const unsigned int *pattern) {
+  unsigned long period = 0;
+  for (const unsigned int *step = pattern; pgm_read_word(step) != 0; step++) {
+    period += pgm_read_word(step);
+  }
+  Channel &c = _channels[channel];
+  noInterrupts();
+  c.pattern = pattern;
+  c.period = period;
+  c.step = 0;
+  c.remaining = pgm_read_word(pattern);
+  if (c.level != HIGH) {
+    c.level = HIGH;
+    c.write(HIGH);
+  }
+  interrupts();
+}
+
+void PulseEngine::set(byte channel, byte level) {
+  Channel &c = _channels[channel];
+  noInterrupts();
+  c.remaining = 0;
+  if (c.level != level) {
+    c.level = level;
+    c.write(level);
+  }
+  interrupts();
+}
+
+unsigned long PulseEngine::timeToNextChange() {
+  unsigned long result = PULSE_ENGINE_NO_CHANGE;
+  noInterrupts();
+  for (byte i = 0; i < _channelCount; i++) {
+    if (_channels[i].remaining != 0 && _channels[i].remaining < result) {
+      result = _channels[i].remaining;
+    }
+  }
+  interrupts();
+  return result;
+}
+
+void PulseEngine::advance(unsigned long ms) {
+  noInterrupts();
+  for (byte i = 0; i < _channelCount; i++) {
+    Channel &c = _channels[i];
+    if (c.remaining == 0) {
+      continue;
+    }
+    unsigned long left = ms;
+    // Skip whole repeats of the pattern without stepping through them
+    left %= c.period;
+    while (left >= c.remaining) {
+      left -= c.remaining;
+      nextStep(c);
+    }
+    c.remaining -= left;
+  }
+  interrupts();
+}
+
+// Level is set by whether the step is odd or even, so a pattern with an odd
+// number of steps runs its last step into its first
+void PulseEngine::nextStep(Channel &channel) {
+  channel.step++;
+  channel.remaining = pgm_read_word(channel.pattern + channel.step);
+  if (channel.remaining == 0) {
+    channel.step = 0;
+    channel.remaining = pgm_read_word(channel.pattern);
+  }
+  byte level = (channel.step & 1) ? LOW : HIGH;
+  if (channel.level != level) {
+    channel.level = level;
+    channel.write(level);
+  }
+}
+
+void PulseEngine::setTickHandler(void (*handler)()) {
+  _tickHandler = handler;
+}
+
+void PulseEngine::tick() {
+  for (byte i = 0; i < _channelCount; i++) {
+    Channel &c = _channels[i];
+    if (c.remaining != 0 && --c.remaining == 0) {
+      nextStep(c);
+    }
+  }
+  if (_tickHandler) {
+    _tickHandler();
+  }
+}
@@ -0,0 +1,91 @@
+/*
+ * pulse_engine.h
+ *
+ * Drives outputs that are pulsed on and off in a pattern, such as the alarm
+ * buzzer and LEDs. Timing is done by a 1 ms Timer1 compare match interrupt that
+ * owns the output pins, so the cadence is exact regardless of what the main
+ * loop is doing. An output pin is only written when its level changes.
+ *
+ * A pattern is an array of step durations in ms, held in PROGMEM, alternately
+ * on & off starting with on, and ended by 0. It's played repeatedly. Each tick
+ * only counts down the current step, and the next step is read from flash when
+ * it ends, so the work done per tick doesn't depend on the pattern.
+ *
+ * Using Timer1 makes PWM unavailable on pins 9 & 10.
+ *
+ * In the host (native) build the simulator stands in for Timer1, calling
+ * advance() as its virtual clock passes each ms.
+ */
+
+#ifndef _PULSE_ENGINE_H
+#define _PULSE_ENGINE_H
+
+#include <Arduino.h>
+#include "fast_pin.h"
+
+// Maximum number of outputs
+#define PULSE_ENGINE_CHANNELS     4
+
+// Returned by timeToNextChange() when no output is pulsing
+#define PULSE_ENGINE_NO_CHANGE    0xFFFFFFFFUL
+
+// Step durations in ms, see above. Declare with PROGMEM.
+typedef unsigned int PulsePattern[];
+
+class PulseEngine {
+
+  public:
+
+    PulseEngine();
+
+    // Registers an output, sets it LOW & returns its channel number. The pin
+    // must already be configured as an output. Call before begin().
+    byte addOutput(PinWriter writer);
+
+    // Starts the timer interrupt
+    void begin();
+
+    // Starts playing a pattern, in PROGMEM, on a channel from its first step.
+    // Must have at least one step.
+    void start(byte channel, const unsigned int *pattern);
+
+    // Stops any pulsing of a channel and holds its output at the given level
+    void set(byte channel, byte level);
+
+    // Returns number of ms until any output next changes level
+    static unsigned long timeToNextChange();
+
+    // Moves all channels forward by the given time. For use after Timer1 has
+    // been stopped, e.g. by sleeping in power-down mode.
+    static void advance(unsigned long ms);
+
+    // Sets a function to be called every ms from the Timer1 interrupt, after
+    // the outputs are updated, e.g. to sample inputs. Not called in the host
+    // build.
+    static void setTickHandler(void (*handler)());
+
+    // Called every ms from the Timer1 interrupt
+    static void tick();
+
+  private:
+
+    struct Channel {
+      PinWriter write;
+      byte level;
+      // Pattern being played & its current step
+      const unsigned int *pattern;
+      byte step;
+      // ms until current step ends, or 0 if not pulsing
+      unsigned int remaining;
+      // Total length of pattern in ms
+      unsigned long period;
+    };
+
+    static Channel _channels[PULSE_ENGINE_CHANNELS];
+    static byte _channelCount;
+    static void (*volatile _tickHandler)();
+
+    static void nextStep(Channel &channel);
+};
+
+#endif
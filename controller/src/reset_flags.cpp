@@ -0,0 +1,37 @@
+/*
+ * reset_flags.cpp
+ *
+ * Saves the reset flags. See reset_flags.h.
+ */
+
+#include "reset_flags.h"
+
+#ifdef __AVR__
+
+#include <avr/wdt.h>
+
+// Not cleared by the C runtime, which runs after the flags are saved
+byte resetFlags __attribute__((section(".noinit")));
+
+// Run from .init3, after the stack is set up & before .bss & .data are. Optiboot
+// clears MCUSR itself, but leaves the flags it read in r2.
+void saveResetFlags() __attribute__((naked, used, section(".init3")));
+
+void saveResetFlags() {
+  byte bootloaderFlags;
+  asm volatile("mov %0, r2" : "=r" (bootloaderFlags));
+  resetFlags = MCUSR ? MCUSR : bootloaderFlags;
+  MCUSR = 0;
+  wdt_disable();
+}
+
+#else
+
+byte resetFlags = 0;
+
+void saveResetFlags() {
+  resetFlags = MCUSR;
+  MCUSR = 0;
+}
+
+#endif
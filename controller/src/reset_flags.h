@@ -0,0 +1,30 @@
+/*
+ * reset_flags.h
+ *
+ * Cause of the last reset of the MCU, as flags from MCUSR.
+ *
+ * After a watchdog reset the watchdog stays enabled, with its shortest
+ * timeout, until WDRF is cleared. Unless that happens before setup() the MCU
+ * would keep resetting and never get as far as watching the gate. So the flags
+ * are saved & cleared, and the watchdog disabled, by code run straight after
+ * the reset vector, before even the C runtime has been set up.
+ *
+ * On the host nothing runs before static initialisation, so the simulator
+ * calls saveResetFlags() itself when it resets the MCU, before setup(). A
+ * harness can set MCUSR before then to simulate any cause of reset.
+ */
+
+#ifndef _RESET_FLAGS_H
+#define _RESET_FLAGS_H
+
+#include <Arduino.h>
+
+// MCUSR flags (PORF, EXTRF, BORF & WDRF) saved at reset
+extern byte resetFlags;
+
+#ifndef __AVR__
+// Saves & clears MCUSR
+void saveResetFlags();
+#endif
+
+#endif
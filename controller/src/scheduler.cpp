@@ -0,0 +1,88 @@
+/*
+ * scheduler.cpp
+ *
+ * Implementation of Scheduler. See scheduler.h.
+ */
+
+#include "scheduler.h"
+
+Scheduler::Scheduler() : _queueLength(0), _taskCount(0) {}
+
+TaskId Scheduler::add(TaskFunction function) {
+  if (_taskCount == SCHEDULER_CAPACITY) {
+    return NO_TASK;
+  }
+  _functions[_taskCount] = function;
+  _deadlines[_taskCount] = Tick();
+  return _taskCount++;
+}
+
+void Scheduler::scheduleAt(TaskId id, Tick deadline) {
+  unqueue(id);
+  _deadlines[id] = deadline;
+  // Insert into queue after any task with the same or an earlier deadline
+  byte pos = _queueLength;
+  while (pos > 0 && deadline.isBefore(_deadlines[_queue[pos - 1]])) {
+    _queue[pos] = _queue[pos - 1];
+    pos--;
+  }
+  _queue[pos] = id;
+  _queueLength++;
+}
+
+void Scheduler::scheduleIn(TaskId id, unsigned long delay, Tick now) {
+  if (delay > SCHEDULER_MAX_DELAY) {
+    delay = SCHEDULER_MAX_DELAY;
+  }
+  scheduleAt(id, now.after(delay));
+}
+
+void Scheduler::repeatAfter(TaskId id, unsigned long period) {
+  scheduleAt(id, _deadlines[id].after(period));
+}
+
+void Scheduler::cancel(TaskId id) {
+  unqueue(id);
+}
+
+boolean Scheduler::isScheduled(TaskId id) const {
+  for (byte i = 0; i < _queueLength; i++) {
+    if (_queue[i] == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Scheduler::runDue(Tick now) {
+  while (_queueLength > 0 && now.hasReached(_deadlines[_queue[0]])) {
+    TaskId id = _queue[0];
+    unqueue(id);
+    _functions[id]();
+  }
+}
+
+unsigned long Scheduler::timeToNextDeadline(Tick now) const {
+  if (_queueLength == 0) {
+    return SCHEDULER_NO_DEADLINE;
+  }
+  Tick deadline = _deadlines[_queue[0]];
+  if (now.hasReached(deadline)) {
+    return 0;
+  }
+  return deadline.since(now);
+}
+
+void Scheduler::unqueue(TaskId id) {
+  byte pos = 0;
+  while (pos < _queueLength && _queue[pos] != id) {
+    pos++;
+  }
+  if (pos == _queueLength) {
+    return;
+  }
+  _queueLength--;
+  for (; pos < _queueLength; pos++) {
+    _queue[pos] = _queue[pos + 1];
+  }
+}
@@ -0,0 +1,85 @@
+/*
+ * scheduler.h
+ *
+ * Simple cooperative scheduler. Each task is a function that is run once its
+ * deadline has passed. Scheduled tasks are kept in a fixed capacity queue that
+ * is ordered by deadline, so finding out whether anything is due, and how long
+ * it is until something will be, only ever requires a look at the head of the
+ * queue.
+ *
+ * Deadlines are Ticks, so are compared in a way that is safe across millis()
+ * rollover, provided no deadline is more than SCHEDULER_MAX_DELAY ms from the
+ * current time. The current time is passed in by the caller, so that every
+ * deadline set in a pass of the main loop is relative to the same time.
+ */
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <Arduino.h>
+#include "tick.h"
+
+// Maximum number of tasks that can be registered
+#define SCHEDULER_CAPACITY    8
+
+// Longest delay that can be scheduled in ms (about 24 days)
+#define SCHEDULER_MAX_DELAY   TICK_MAX_SPAN
+
+// Returned by timeToNextDeadline() when no tasks are scheduled
+#define SCHEDULER_NO_DEADLINE 0xFFFFFFFFUL
+
+// Returned by add() when there is no room for another task
+#define NO_TASK 0xFF
+
+typedef void (*TaskFunction)();
+typedef byte TaskId;
+
+class Scheduler {
+
+  public:
+
+    Scheduler();
+
+    // Registers a task and returns its id, or NO_TASK if there's no room. The
+    // task does not run until it is scheduled.
+    TaskId add(TaskFunction function);
+
+    // Schedules a task to run at the given time, replacing any existing
+    // deadline
+    void scheduleAt(TaskId id, Tick deadline);
+
+    // Schedules a task to run after the given delay from now. Delays longer
+    // than SCHEDULER_MAX_DELAY are shortened to that value.
+    void scheduleIn(TaskId id, unsigned long delay, Tick now);
+
+    // Schedules a task to run the given time after its previous deadline. When
+    // called from a running task this gives a period that doesn't drift with
+    // the time taken to get round to running the task.
+    void repeatAfter(TaskId id, unsigned long period);
+
+    void cancel(TaskId id);
+
+    boolean isScheduled(TaskId id) const;
+
+    // Runs every task whose deadline is at or before now, earliest first. A
+    // task is removed from the queue before it is run, so it may reschedule
+    // itself.
+    void runDue(Tick now);
+
+    // Returns number of ms from now until the earliest deadline, 0 if a task
+    // is already due, or SCHEDULER_NO_DEADLINE if nothing is scheduled.
+    unsigned long timeToNextDeadline(Tick now) const;
+
+  private:
+
+    TaskFunction _functions[SCHEDULER_CAPACITY];
+    Tick _deadlines[SCHEDULER_CAPACITY];
+    // Ids of scheduled tasks, in order of deadline
+    TaskId _queue[SCHEDULER_CAPACITY];
+    byte _queueLength;
+    byte _taskCount;
+
+    void unqueue(TaskId id);
+};
+
+#endif
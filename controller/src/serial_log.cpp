@@ -0,0 +1,140 @@
+/*
+ * serial_log.cpp
+ *
+ * Implementation of SerialLog. See serial_log.h.
+ */
+
+#include "serial_log.h"
+
+#ifndef __AVR__
+#include "sim.h"
+#endif
+
+// Instance the interrupts pass characters to, set by begin()
+static SerialLog *instance = NULL;
+
+#ifdef __AVR__
+
+ISR(USART_UDRE_vect) {
+  instance->onTransmitReady();
+}
+
+ISR(USART_RX_vect) {
+  instance->onReceive(UDR0);
+}
+
+#endif
+
+SerialLog::SerialLog() : _dropping(false), _dropped(0), _written(false) {}
+
+void SerialLog::begin(unsigned long baud) {
+  instance = this;
+#ifdef __AVR__
+  // Double speed mode gives smaller baud rate errors at high rates, see
+  // HardwareSerial
+  UCSR0A = _BV(U2X0);
+  UBRR0 = (F_CPU / 4 / baud - 1) / 2;
+  // 8 data bits, no parity, 1 stop bit
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+#else
+  (void) baud;
+#endif
+}
+
+size_t SerialLog::write(uint8_t c) {
+#ifdef __AVR__
+  if (_dropping) {
+    if (c != '\n') {
+      return 0;
+    }
+    _dropping = false;
+  }
+  // Always leave room for the newline that ends a line cut short
+  else if (c != '\n' && _tx.space() < 2) {
+    _dropping = true;
+    _dropped++;
+    return 0;
+  }
+  _tx.push(c);
+  startTransmit();
+#else
+  sim::serialWrite(&c, 1);
+#endif
+  return 1;
+}
+
+void SerialLog::writeRecord(const byte *record, byte length) {
+#ifdef __AVR__
+  // Keep room for the newline that ends any line cut short
+  if (_tx.space() < length + 1) {
+    _dropped++;
+    return;
+  }
+  for (byte i = 0; i < length; i++) {
+    _tx.push(record[i]);
+  }
+  startTransmit();
+#else
+  sim::serialWrite(record, length);
+#endif
+}
+
+int SerialLog::availableForWrite() {
+#ifdef __AVR__
+  // Room is kept for the newline ending a line cut short
+  return _tx.space() - 1;
+#else
+  return SERIAL_LOG_TX_BUFFER_SIZE - 1;
+#endif
+}
+
+int SerialLog::read() {
+#ifdef __AVR__
+  char c;
+  return _rx.pop(c) ? (byte) c : -1;
+#else
+  return sim::serialRead();
+#endif
+}
+
+void SerialLog::flush() {
+#ifdef __AVR__
+  // TXC0 is never set if nothing has been sent
+  if (!_written) {
+    return;
+  }
+  while (!_tx.isEmpty() || (UCSR0B & _BV(UDRIE0))) {}
+  // Wait for last character to leave the shift register
+  while (!(UCSR0A & _BV(TXC0))) {}
+#endif
+}
+
+#ifdef __AVR__
+void SerialLog::startTransmit() {
+  _written = true;
+  // UCSR0B is out of range of sbi, so the read-modify-write must not be split
+  // by the interrupt, which clears UDRIE0 when the buffer empties
+  noInterrupts();
+  UCSR0B |= _BV(UDRIE0);
+  interrupts();
+}
+#endif
+
+void SerialLog::onTransmitReady() {
+#ifdef __AVR__
+  char c;
+  if (_tx.pop(c)) {
+    UDR0 = c;
+    // Writing 1 clears the transmit complete flag, keeping U2X0
+    UCSR0A = _BV(U2X0) | _BV(TXC0);
+  }
+  else {
+    UCSR0B &= ~_BV(UDRIE0);
+  }
+#endif
+}
+
+void SerialLog::onReceive(byte c) {
+  _rx.push(c);
+}
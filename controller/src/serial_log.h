@@ -0,0 +1,69 @@
+/*
+ * serial_log.h
+ *
+ * Debug output over the serial port that never stalls the caller. Text is
+ * buffered and sent by the UART data register empty interrupt, and incoming
+ * characters are buffered by the receive interrupt.
+ *
+ * If the buffer fills, the rest of the line being written is dropped: the line
+ * ends early with its newline, so later lines stay intact. Binary records are
+ * either written in full or dropped. The number of lines cut short & records
+ * dropped is counted.
+ *
+ * Takes over the UART from HardwareSerial, so Serial must not be used.
+ */
+
+#ifndef _SERIAL_LOG_H
+#define _SERIAL_LOG_H
+
+#include <Arduino.h>
+#include "spsc_queue.h"
+
+// Size of transmit & receive buffers. Must be powers of 2 no greater than 128.
+#define SERIAL_LOG_TX_BUFFER_SIZE   128
+#define SERIAL_LOG_RX_BUFFER_SIZE   16
+
+class SerialLog : public Print {
+
+  public:
+
+    SerialLog();
+
+    void begin(unsigned long baud);
+
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+    // Writes all of a binary record or, if there isn't room, none of it
+    void writeRecord(const byte *record, byte length);
+
+    // Number of bytes that can be written without any being dropped
+    int availableForWrite();
+
+    // Returns next character received or -1 if none
+    int read();
+
+    // Waits until everything buffered has been sent
+    void flush();
+
+    // Number of lines cut short & records dropped since start up
+    unsigned int dropped() const { return _dropped; }
+
+    // Called from the UART interrupts
+    void onTransmitReady();
+    void onReceive(byte c);
+
+  private:
+
+    SpscQueue<char, SERIAL_LOG_TX_BUFFER_SIZE> _tx;
+    SpscQueue<char, SERIAL_LOG_RX_BUFFER_SIZE> _rx;
+    // True while discarding the rest of a line that didn't fit
+    boolean _dropping;
+    unsigned int _dropped;
+    // True once anything has been sent
+    boolean _written;
+
+    void startTransmit();
+};
+
+#endif
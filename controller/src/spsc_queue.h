@@ -0,0 +1,89 @@
+/*
+ * spsc_queue.h
+ *
+ * Fixed capacity, lock-free queue with a single producer and a single consumer.
+ * Intended for passing data between an interrupt service routine and the main
+ * loop, in either direction, without disabling interrupts.
+ *
+ * Each index is only ever written by one side and is a single byte, so reads
+ * and writes of it are atomic on AVR. Compiler barriers stop accesses to the
+ * items being moved across updates of the indices.
+ */
+
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+#include <Arduino.h>
+
+// CAPACITY must be a power of two no greater than 128.
+template <typename T, byte CAPACITY>
+class SpscQueue {
+
+  static_assert(CAPACITY > 0 && CAPACITY <= 128 && (CAPACITY & (CAPACITY - 1)) == 0,
+    "SpscQueue capacity must be a power of two no greater than 128");
+
+  public:
+
+    SpscQueue() : _head(0), _tail(0), _overflowed(false) {}
+
+    // Producer only. Returns false, and records the overflow, if the queue is
+    // full.
+    boolean push(const T &item) {
+      byte head = _head;
+      if ((byte)(head - _tail) == CAPACITY) {
+        _overflowed = true;
+        return false;
+      }
+      _items[head & (CAPACITY - 1)] = item;
+      asm volatile ("" ::: "memory");
+      _head = head + 1;
+      return true;
+    }
+
+    // Consumer only. Returns false if the queue is empty.
+    boolean pop(T &item) {
+      byte tail = _tail;
+      if (tail == _head) {
+        return false;
+      }
+      asm volatile ("" ::: "memory");
+      item = _items[tail & (CAPACITY - 1)];
+      asm volatile ("" ::: "memory");
+      _tail = tail + 1;
+      return true;
+    }
+
+    boolean isEmpty() const {
+      return _tail == _head;
+    }
+
+    // Producer only
+    boolean isFull() const {
+      return (byte)(_head - _tail) == CAPACITY;
+    }
+
+    // Producer only. Number of items that can be pushed.
+    byte space() const {
+      return CAPACITY - (byte)(_head - _tail);
+    }
+
+    // Consumer only. Returns true if any item has been discarded because the
+    // queue was full since the last call.
+    boolean checkOverflow() {
+      if (!_overflowed) {
+        return false;
+      }
+      _overflowed = false;
+      return true;
+    }
+
+  private:
+
+    T _items[CAPACITY];
+    // Free running counters: the difference is the number of items queued
+    volatile byte _head;
+    volatile byte _tail;
+    volatile boolean _overflowed;
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * state_store.cpp
+ *
+ * Implementation of StateStore. See state_store.h.
+ */
+
+#include "state_store.h"
+#include "crc8.h"
+
+static byte stateCrc(SavedState state) {
+  state.crc = 0;
+  return crc8(&state, sizeof(state));
+}
+
+StateStore::StateStore(EepromWriter &writer) : _writer(writer), _next(0), _haveLast(false) {}
+
+boolean StateStore::begin(SavedState &state) {
+  // Sequence numbers of the copies held are consecutive, so are compared
+  // relative to any one of them
+  for (byte slot = 0; slot < STATE_STORE_SLOTS; slot++) {
+    SavedState copy;
+    if (!readSlot(slot, copy)) {
+      continue;
+    }
+    if (!_haveLast || (int8_t) (copy.sequence - _last.sequence) > 0) {
+      _last = copy;
+      _next = (slot + 1) % STATE_STORE_SLOTS;
+      _haveLast = true;
+    }
+  }
+  if (_haveLast) {
+    state = _last;
+  }
+  return _haveLast;
+}
+
+void StateStore::save(const SavedState &state) {
+  if (_haveLast && isSameState(state, _last)) {
+    return;
+  }
+  SavedState copy = state;
+  copy.sequence = _haveLast ? _last.sequence + 1 : 0;
+  copy.unused = 0;
+  copy.reserved = 0;
+  copy.crc = stateCrc(copy);
+  if (!_writer.write(STATE_STORE_START + _next * sizeof(SavedState), &copy, sizeof(copy))) {
+    return;
+  }
+  _last = copy;
+  _haveLast = true;
+  _next = (_next + 1) % STATE_STORE_SLOTS;
+}
+
+boolean StateStore::isSameState(const SavedState &a, const SavedState &b) {
+  return a.gateOpen == b.gateOpen
+    && a.alarmSounding == b.alarmSounding
+    && a.suspension == b.suspension
+    && a.openZones == b.openZones
+    && a.suspendMinutesLeft == b.suspendMinutesLeft;
+}
+
+boolean StateStore::readSlot(byte slot, SavedState &state) {
+  EepromWriter::read(STATE_STORE_START + slot * sizeof(SavedState), &state, sizeof(state));
+  return state.unused == 0 && state.reserved == 0 && state.crc == stateCrc(state);
+}
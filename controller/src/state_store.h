@@ -0,0 +1,80 @@
+/*
+ * state_store.h
+ *
+ * Keeps a copy of the alarm's state in EEPROM, so it can be restored after a
+ * reset or power loss.
+ *
+ * The state is checkpointed by passing it to save() whenever it may have
+ * changed: it's only written if it differs from the last copy saved. Copies are
+ * written in turn to a small ring of slots after the journal, each with a
+ * sequence number & CRC, so wear is spread over the slots and a copy that was
+ * only partly written when power failed is ignored in favour of the one before.
+ */
+
+#ifndef _STATE_STORE_H
+#define _STATE_STORE_H
+
+#include <Arduino.h>
+#include "eeprom_writer.h"
+#include "journal.h"
+
+// EEPROM used to store state: the space after the journal
+#define STATE_STORE_START     JOURNAL_END
+#define STATE_STORE_SLOTS     8
+
+// Values of SavedState::suspension
+#define SAVED_NOT_SUSPENDED       0
+#define SAVED_SUSPENDED_TIMED     1
+#define SAVED_SUSPENDED_FOREVER   2
+
+struct SavedState {
+  byte sequence;
+  // CRC of state with this field set to 0
+  byte crc;
+  byte gateOpen : 1;
+  byte alarmSounding : 1;
+  byte suspension : 2;
+  // Always 0, as is reserved, so erased EEPROM is never taken for a valid copy
+  byte unused : 4;
+  // Mask of zones opened, see zone_monitor.h
+  byte openZones;
+  // Minutes of a timed suspension left, rounded up
+  uint16_t suspendMinutesLeft;
+  uint16_t reserved;
+};
+
+static_assert(sizeof(SavedState) == 8, "SavedState layout must match copies in EEPROM");
+
+// End of EEPROM used to store state
+#define STATE_STORE_END   (STATE_STORE_START + STATE_STORE_SLOTS * sizeof(SavedState))
+
+static_assert(STATE_STORE_END <= EEPROM_WRITER_SIZE, "State store must fit in EEPROM");
+
+class StateStore {
+
+  public:
+
+    StateStore(EepromWriter &writer);
+
+    // Finds the last state saved. Returns true & sets state to it if there is
+    // one. Call once at start up, before save().
+    boolean begin(SavedState &state);
+
+    // Queues state to be written if it differs from the last state saved. The
+    // sequence & crc fields are ignored. If the write queue is full nothing is
+    // written, so it's tried again on the next call.
+    void save(const SavedState &state);
+
+  private:
+
+    EepromWriter &_writer;
+    // Slot for next copy
+    byte _next;
+    SavedState _last;
+    boolean _haveLast;
+
+    static boolean isSameState(const SavedState &a, const SavedState &b);
+    static boolean readSlot(byte slot, SavedState &state);
+};
+
+#endif
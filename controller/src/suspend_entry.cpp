@@ -0,0 +1,29 @@
+/*
+ * suspend_entry.cpp
+ *
+ * Implementation of SuspendEntry. See suspend_entry.h.
+ */
+
+#include "suspend_entry.h"
+#include "alarm_fsm.h"
+
+boolean SuspendEntry::addDigit(byte digit) {
+  if (!_isEntering) {
+    _isEntering = true;
+    _minutes = digit;
+    return true;
+  }
+  if (_minutes > (MAX_SUSPEND_MINUTES - digit) / SUSPEND_ENTRY_BASE) {
+    return false;
+  }
+  _minutes = _minutes * SUSPEND_ENTRY_BASE + digit;
+  return true;
+}
+
+byte SuspendEntry::finish() {
+  if (!_isEntering) {
+    return EVENT_SUSPEND_FOREVER;
+  }
+  _isEntering = false;
+  return _minutes != 0 ? EVENT_SUSPEND : EVENT_RESUME;
+}
@@ -0,0 +1,49 @@
+/*
+ * suspend_entry.h
+ *
+ * Entry of a suspension time in minutes on the keypad. Digits build up the
+ * time & # finishes the entry, which results in an event for AlarmFsm: suspend
+ * for the time entered, or resume if it's 0. # with no entry under way
+ * suspends indefinitely.
+ *
+ * Like AlarmFsm it has no dependencies on hardware, so tools/explore can run it
+ * on the host.
+ */
+
+#ifndef _SUSPEND_ENTRY_H
+#define _SUSPEND_ENTRY_H
+
+#include <Arduino.h>
+
+#define SUSPEND_ENTRY_BASE    10
+
+// Longest suspension that can be entered in minutes, about a week
+#define MAX_SUSPEND_MINUTES   9999U
+
+class SuspendEntry {
+
+  public:
+
+    SuspendEntry() : _isEntering(false), _minutes(0) {}
+
+    // Adds a digit to the time, starting an entry if none is under way.
+    // Returns false, ignoring the digit, if it would take the time over
+    // MAX_SUSPEND_MINUTES.
+    boolean addDigit(byte digit);
+
+    // Finishes any entry under way & returns the event it results in:
+    // EVENT_SUSPEND, EVENT_RESUME or EVENT_SUSPEND_FOREVER
+    byte finish();
+
+    boolean isEntering() const { return _isEntering; }
+
+    // Time entered so far, or by the last entry finished
+    unsigned int minutes() const { return _minutes; }
+
+  private:
+
+    boolean _isEntering;
+    unsigned int _minutes;
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * tick.h
+ *
+ * A point in time, as a millis() value. millis() rolls over every 49.7 days, so
+ * two ticks can't be compared with < or >: they're compared by the sign of the
+ * difference between them, which is right provided they're less than
+ * TICK_MAX_SPAN ms apart. The plain comparison operators are deleted so that no
+ * other kind of comparison compiles.
+ *
+ * Durations are plain unsigned long ms. The time from one tick to a later one
+ * is right across rollover, as unsigned subtraction wraps with millis(). Ticks
+ * are held in 32 bits, as on the MCU, so this is true of host builds too,
+ * where unsigned long is wider.
+ */
+
+#ifndef _TICK_H
+#define _TICK_H
+
+#include <Arduino.h>
+
+// Furthest apart in ms two ticks can be and still be compared (about 24 days)
+#define TICK_MAX_SPAN   0x7FFFFFFFUL
+
+class Tick {
+
+  public:
+
+    constexpr Tick() : _ms(0) {}
+    constexpr explicit Tick(unsigned long ms) : _ms((uint32_t) ms) {}
+
+    static Tick now() { return Tick(millis()); }
+
+    // millis() value, e.g. for logging
+    constexpr unsigned long ms() const { return _ms; }
+
+    // Tick the given number of ms later
+    constexpr Tick after(unsigned long ms) const { return Tick((uint32_t) (_ms + ms)); }
+
+    // ms from an earlier tick to this one
+    constexpr unsigned long since(Tick earlier) const { return (uint32_t) (_ms - earlier._ms); }
+
+    constexpr boolean isBefore(Tick other) const { return (int32_t) (_ms - other._ms) < 0; }
+    constexpr boolean isAfter(Tick other) const { return other.isBefore(*this); }
+
+    // True once this tick is at or after a deadline
+    constexpr boolean hasReached(Tick deadline) const { return !isBefore(deadline); }
+
+    constexpr boolean operator==(Tick other) const { return _ms == other._ms; }
+    constexpr boolean operator!=(Tick other) const { return _ms != other._ms; }
+
+    bool operator<(Tick) const = delete;
+    bool operator<=(Tick) const = delete;
+    bool operator>(Tick) const = delete;
+    bool operator>=(Tick) const = delete;
+
+  private:
+
+    uint32_t _ms;
+};
+
+// Comparisons across rollover
+static_assert(Tick(0xFFFFFFF0UL).isBefore(Tick(0x10)), "Tick before rollover must be before one after");
+static_assert(Tick(0x10).isAfter(Tick(0xFFFFFFF0UL)), "Tick after rollover must be after one before");
+static_assert(Tick(0x10).since(Tick(0xFFFFFFF0UL)) == 0x20, "Time across rollover must be exact");
+static_assert(Tick(0xFFFFFFF0UL).after(0x20) == Tick(0x10), "Deadline across rollover must wrap");
+static_assert(Tick(5).hasReached(Tick(5)) && !Tick(4).hasReached(Tick(5)), "Deadline must be reached at its tick");
+static_assert(Tick(0).after(TICK_MAX_SPAN).isAfter(Tick(0)), "Ticks up to TICK_MAX_SPAN apart must compare");
+
+#endif
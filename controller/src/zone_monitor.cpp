@@ -0,0 +1,125 @@
+/*
+ * zone_monitor.cpp
+ *
+ * Implementation of ZoneMonitor. See zone_monitor.h.
+ */
+
+#include "zone_monitor.h"
+#include "pulse_engine.h"
+
+#ifndef __AVR__
+#include "sim.h"
+#endif
+
+#define ZONE_MASK   ((1 << ZONE_COUNT) - 1)
+
+// Number of samples in a row that must differ from a zone's state to change it
+#define ZONE_SAMPLES_TO_CHANGE  4
+
+constexpr byte ZoneMonitor::PINS[ZONE_COUNT];
+
+// read() takes zone 1 from PD2, which is pin 2, & the rest from PC0 up, which
+// are A0 up
+static_assert(ZONE_COUNT == 5 && ZoneMonitor::PINS[0] == 2 && ZoneMonitor::PINS[1] == A0
+  && ZoneMonitor::PINS[2] == A1 && ZoneMonitor::PINS[3] == A2 && ZoneMonitor::PINS[4] == A3,
+  "ZoneMonitor::read() must be changed to match the zone pins");
+
+volatile byte ZoneMonitor::_state = 0;
+volatile byte ZoneMonitor::_count0 = 0;
+volatile byte ZoneMonitor::_count1 = 0;
+volatile byte ZoneMonitor::_opened = 0;
+byte ZoneMonitor::_countdown = ZONE_SAMPLE_INTERVAL;
+
+ZoneMonitor::ZoneMonitor() {}
+
+void ZoneMonitor::begin() {
+  for (byte i = 0; i < ZONE_COUNT; i++) {
+    pinMode(PINS[i], INPUT_PULLUP);
+  }
+  noInterrupts();
+  _state = read();
+  _count0 = _count1 = _opened = 0;
+  _countdown = ZONE_SAMPLE_INTERVAL;
+  interrupts();
+#ifdef __AVR__
+  PulseEngine::setTickHandler(tick);
+#else
+  sim::attachTimer(timeToNextSample, advance);
+#endif
+}
+
+byte ZoneMonitor::takeOpened() {
+  noInterrupts();
+  byte opened = _opened;
+  _opened = 0;
+  interrupts();
+  return opened;
+}
+
+boolean ZoneMonitor::isSettling() const {
+  return _opened != 0 || (_count0 | _count1) != 0 || read() != _state;
+}
+
+unsigned long ZoneMonitor::timeToSettle() const {
+  if (_opened != 0) {
+    return 0;
+  }
+  return isSettling() ? _countdown : ZONE_MONITOR_STEADY;
+}
+
+void ZoneMonitor::tick() {
+  if (--_countdown == 0) {
+    _countdown = ZONE_SAMPLE_INTERVAL;
+    sample();
+  }
+}
+
+// Returns mask of zones that are open, i.e. whose inputs are LOW
+byte ZoneMonitor::read() {
+#ifdef __AVR__
+  // Zone 1 is PD2, zones 2 to 5 are PC0 to PC3, as in PINS: see above
+  byte closed = ((PIND >> PIND2) & 0x01) | ((PINC & 0x0F) << 1);
+#else
+  byte closed = 0;
+  for (byte i = 0; i < ZONE_COUNT; i++) {
+    closed |= digitalRead(PINS[i]) << i;
+  }
+#endif
+  return ~closed & ZONE_MASK;
+}
+
+// Counts each zone that differs from its state up from 0 to 3, then changes
+// its state on the next sample, when its count wraps to 0. Zones that don't
+// differ have their counts cleared.
+void ZoneMonitor::sample() {
+  byte delta = read() ^ _state;
+  _count1 = (_count1 ^ _count0) & delta;
+  _count0 = ~_count0 & delta;
+  byte changed = delta & ~(_count0 | _count1);
+  _state ^= changed;
+  _opened |= changed & _state;
+}
+
+// Used by the simulator in place of tick(). Only needs samples taken while a
+// zone is changing.
+unsigned long ZoneMonitor::timeToNextSample() {
+  if ((_count0 | _count1) == 0 && read() == _state) {
+    return 0xFFFFFFFFUL;
+  }
+  return _countdown;
+}
+
+// Used by the simulator in place of tick(). Inputs don't change part way
+// through the time, so only the first few samples taken can change anything.
+void ZoneMonitor::advance(unsigned long ms) {
+  if (ms < _countdown) {
+    _countdown -= ms;
+    return;
+  }
+  ms -= _countdown;
+  unsigned long samples = 1 + ms / ZONE_SAMPLE_INTERVAL;
+  _countdown = ZONE_SAMPLE_INTERVAL - ms % ZONE_SAMPLE_INTERVAL;
+  for (byte i = 0; i < samples && i < ZONE_SAMPLES_TO_CHANGE; i++) {
+    sample();
+  }
+}
@@ -0,0 +1,86 @@
+/*
+ * zone_monitor.h
+ *
+ * Debounced inputs for the reed switches of up to ZONE_COUNT (5) gates, or
+ * zones, each with a test button in parallel. A switch closes, pulling its input LOW, when its
+ * gate opens.
+ *
+ * All zones are read together, as a bit mask, every ZONE_SAMPLE_INTERVAL ms by
+ * the Timer1 interrupt & debounced in parallel using vertical counters: bit n
+ * of each of two counter bytes makes up a 2 bit counter for zone n. A zone's
+ * counter counts samples that differ from its debounced state & is cleared by
+ * any sample that doesn't, and the state changes on the 4th sample in a row to
+ * differ. So debouncing all the zones takes a handful of bitwise operations,
+ * and a change is never missed however long the main loop is busy.
+ *
+ * Timer1 stops in power-down, so the MCU must not power down while
+ * isSettling(). Add the zone pins as wake pins, so a change wakes the MCU.
+ *
+ * On the Nano there's no 8 bit port free, so zone 1 is on pin 2, where the
+ * single reed switch has always been, and zones 2 to 5 on A0 to A3: two port
+ * reads. Unconnected zones are pulled up, so read as closed.
+ */
+
+#ifndef _ZONE_MONITOR_H
+#define _ZONE_MONITOR_H
+
+#include <Arduino.h>
+
+#define ZONE_COUNT              5
+
+// Interval between samples in ms. 4 samples in a row must agree, so changes
+// shorter than 3 intervals are ignored & a change is seen within 4.
+#define ZONE_SAMPLE_INTERVAL    12
+
+// Returned by timeToSettle() when no zone is changing
+#define ZONE_MONITOR_STEADY     0xFFFFFFFFUL
+
+class ZoneMonitor {
+
+  public:
+
+    // Pins of zones in order. Zone n is bit n - 1 of masks. read() takes the
+    // zones straight from the ports these are on, which zone_monitor.cpp
+    // checks.
+    static constexpr byte PINS[ZONE_COUNT] = {2, A0, A1, A2, A3};
+
+    ZoneMonitor();
+
+    // Configures the pins & takes the state of each zone as its starting
+    // state. Sampling starts once PulseEngine::begin() has started Timer1.
+    void begin();
+
+    // Returns mask of zones that have opened since the last call
+    byte takeOpened();
+
+    // Returns mask of zones currently open, after debouncing
+    byte openZones() const { return _state; }
+
+    // Returns true while a zone is changing & being debounced, or a change is
+    // waiting for takeOpened()
+    boolean isSettling() const;
+
+    // Returns the number of ms until the main loop next needs to check for a
+    // change, or ZONE_MONITOR_STEADY if none are changing
+    unsigned long timeToSettle() const;
+
+    // Called every ms from the Timer1 interrupt
+    static void tick();
+
+  private:
+
+    // Debounced state & vertical counter bits
+    static volatile byte _state;
+    static volatile byte _count0;
+    static volatile byte _count1;
+    static volatile byte _opened;
+    // ms until next sample
+    static byte _countdown;
+
+    static byte read();
+    static void sample();
+    static unsigned long timeToNextSample();
+    static void advance(unsigned long ms);
+};
+
+#endif
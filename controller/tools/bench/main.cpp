@@ -0,0 +1,133 @@
+/*
+ * main.cpp
+ *
+ * Benchmarks the controller firmware on the host. Each scenario boots the
+ * firmware, waits for start up to finish, applies the scenario's inputs and
+ * then measures a fixed period of simulated time, reporting:
+ *
+ *   - passes of loop() per second, i.e. how often the MCU wakes
+ *   - bytes written over I2C
+ *   - LCD clear display instructions
+ *
+ * Each scenario runs in its own process, so all start from a freshly booted
+ * controller. Build & run with:
+ *
+ *   pio run -e bench && .pio/build/bench/program [scenario...]
+ *
+ * With no arguments all scenarios are run. Requires a POSIX host.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "sim.h"
+
+// Must match main.cpp
+#define MAGNET_SWITCH_PIN   2
+
+// Time allowed for start up in ms
+#define WARM_UP_TIME        5000
+
+// Time measured in ms
+#define MEASURE_TIME        60000
+
+// Time between key presses in the keypad scenario in ms
+#define KEY_INTERVAL        100
+
+struct Scenario {
+  const char *name;
+  // Sets up inputs for a scenario starting at the given time
+  void (*start)(uint64_t now);
+};
+
+static void startIdle(uint64_t) {}
+
+static void startGateOpen(uint64_t) {
+  sim::setPin(MAGNET_SWITCH_PIN, LOW);
+}
+
+static void startTimedSuspension(uint64_t) {
+  sim::pressKey('5');
+  sim::pressKey('#');
+}
+
+static void startInfiniteSuspension(uint64_t) {
+  sim::pressKey('#');
+}
+
+// Repeatedly enters a suspension time and then resets
+static void startKeypadEntry(uint64_t now) {
+  static const char KEYS[] = "12#*";
+  byte index = 0;
+  for (uint64_t t = now; t < now + MEASURE_TIME; t += KEY_INTERVAL) {
+    char key = KEYS[index];
+    sim::at(t, [key]() { sim::pressKey(key); });
+    index = (index + 1) % (sizeof(KEYS) - 1);
+  }
+}
+
+static const Scenario SCENARIOS[] = {
+  {"idle", startIdle},
+  {"gate-open", startGateOpen},
+  {"timed-suspension", startTimedSuspension},
+  {"infinite-suspension", startInfiniteSuspension},
+  {"keypad-entry", startKeypadEntry}
+};
+
+static void run(const Scenario &scenario) {
+  sim::setSerialOutput(NULL);
+  sim::begin();
+  sim::runUntil(WARM_UP_TIME);
+
+  scenario.start(sim::nowMillis());
+  unsigned long loops = sim::loopCount();
+  unsigned long i2cBytes = sim::i2cBytes();
+  unsigned long clears = sim::lcd().clearCount();
+
+  sim::runFor(MEASURE_TIME);
+
+  printf(
+    "%-20s %8.1f %10lu %7lu\n",
+    scenario.name, (sim::loopCount() - loops) * 1000.0 / MEASURE_TIME, sim::i2cBytes() - i2cBytes,
+    sim::lcd().clearCount() - clears
+  );
+}
+
+static bool isSelected(const char *name, int argc, char *argv[]) {
+  if (argc < 2) {
+    return true;
+  }
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  printf("Over %d s after start up:\n\n", MEASURE_TIME / 1000);
+  printf("%-20s %8s %10s %7s\n", "scenario", "loops/s", "I2C bytes", "clears");
+  int result = 0;
+  for (const Scenario &scenario : SCENARIOS) {
+    if (!isSelected(scenario.name, argc, argv)) {
+      continue;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      run(scenario);
+      fflush(stdout);
+      _exit(0);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "%s: failed\n", scenario.name);
+      result = 1;
+    }
+  }
+  return result;
+}
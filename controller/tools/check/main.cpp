@@ -0,0 +1,132 @@
+/*
+ * main.cpp
+ *
+ * Checks of the controller firmware on the host that need the simulated
+ * hardware set up in a way the scenario tools never do. Build & run with:
+ *
+ *   pio run -e check && .pio/build/check/program
+ *
+ * The firmware can't be restarted, so the checks run one after another on
+ * the same controller, each leaving it armed & idle. Each failure is printed
+ * & the exit status is 1 if any check failed.
+ */
+
+#include <stdio.h>
+
+#include <string>
+
+#include "Arduino.h"
+#include "async_lcd.h"
+#include "journal.h"
+#include "reset_flags.h"
+#include "sim.h"
+
+// Must match main.cpp
+#define KEYPAD_COLS             3
+
+// Keypad column pins, from main.cpp
+extern byte colPins[KEYPAD_COLS];
+
+extern AsyncLcd lcd;
+
+extern Journal journal;
+
+// Cause of the simulated reset: the watchdog fired as the supply browned out
+#define RESET_FLAGS             (_BV(WDRF) | _BV(BORF))
+
+// Time allowed for start up in ms
+#define WARM_UP_TIME            5000
+
+// Time allowed for the firmware to act on an input in ms
+#define SETTLE_TIME             1000
+
+static unsigned long failures = 0;
+
+static void expect(bool ok, const char *check) {
+  if (!ok) {
+    printf("%lu ms: FAILED: %s\n", (unsigned long) sim::nowMillis(), check);
+    failures++;
+  }
+}
+
+// LCD line without the spaces that centre it
+static std::string lcdLine(byte row) {
+  std::string line = sim::lcd().line(row);
+  size_t first = line.find_first_not_of(' ');
+  if (first == std::string::npos) {
+    return "";
+  }
+  return line.substr(first, line.find_last_not_of(' ') + 1 - first);
+}
+
+// The reset flags are saved & cleared before setup(), as otherwise the
+// watchdog would stay enabled after a watchdog reset & keep resetting the MCU,
+// and the cause of the reset is journalled
+static void checkResetFlagsSaved() {
+  expect(resetFlags == RESET_FLAGS, "reset flags saved");
+  expect(MCUSR == 0, "MCUSR cleared, so watchdog reset flag cleared");
+  JournalRecord record;
+  expect(
+    journal.count() >= 1 && journal.read(0, record) && record.event == JOURNAL_BOOT && record.duration == RESET_FLAGS,
+    "reset flags journalled at boot"
+  );
+  expect(lcdLine(0) == "OK", "alarm armed after watchdog & brown-out reset");
+}
+
+// Between scans the keypad's columns are driven LOW, so a key pulls its row
+// LOW & wakes the MCU. If they weren't, a key press while asleep would be lost.
+static void checkKeyWakesOnlyWithColumnsDriven() {
+  unsigned long ignored = sim::ignoredKeyCount();
+  for (byte i = 0; i < KEYPAD_COLS; i++) {
+    pinMode(colPins[i], INPUT);
+  }
+  sim::pressKey('5');
+  sim::runFor(SETTLE_TIME);
+  expect(sim::ignoredKeyCount() == ignored + 1, "key ignored while columns not driven");
+  expect(lcdLine(0) == "OK", "display unchanged by key while columns not driven");
+
+  for (byte i = 0; i < KEYPAD_COLS; i++) {
+    pinMode(colPins[i], OUTPUT);
+    digitalWrite(colPins[i], LOW);
+  }
+  sim::pressKey('5');
+  sim::runFor(SETTLE_TIME);
+  expect(sim::ignoredKeyCount() == ignored + 1, "key read while columns driven");
+  expect(lcdLine(0) == "Enter delay:" && lcdLine(1) == "5", "display shows key pressed while columns driven");
+
+  // Finishing the entry suspends the alarm & reset then ends the suspension
+  sim::pressKey('#');
+  sim::pressKey('*');
+  sim::runFor(SETTLE_TIME);
+  expect(lcdLine(0) == "OK", "alarm armed after 5# & reset");
+}
+
+// AsyncLcd counts the bytes it sends, for the display update log. None are
+// sent when the display doesn't acknowledge its address.
+static void checkI2CBytesCounted() {
+  expect(lcd.bytesSent() == sim::i2cBytes(), "I2C bytes counted since start up");
+
+  sim::setI2CConnected(false);
+  sim::pressKey('7');
+  sim::runFor(SETTLE_TIME);
+  sim::setI2CConnected(true);
+  sim::pressKey('#');
+  sim::pressKey('*');
+  sim::runFor(SETTLE_TIME);
+  expect(lcd.bytesSent() == sim::i2cBytes(), "I2C bytes counted with display disconnected");
+  expect(lcdLine(0) == "OK", "alarm armed after 7# & reset");
+}
+
+int main() {
+  sim::setSerialOutput(NULL);
+  MCUSR = RESET_FLAGS;
+  sim::begin();
+  sim::runFor(WARM_UP_TIME);
+
+  checkResetFlagsSaved();
+  checkKeyWakesOnlyWithColumnsDriven();
+  checkI2CBytesCounted();
+
+  printf("%lu failures\n", failures);
+  return failures > 0 ? 1 : 0;
+}
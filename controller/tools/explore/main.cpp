@@ -0,0 +1,305 @@
+/*
+ * main.cpp
+ *
+ * Explores every reachable state of the controller's logic on the host,
+ * breadth first from start up, applying every input in every state. The logic
+ * is the firmware's own AlarmFsm & SuspendEntry, with inputs mapped to them as
+ * main.cpp does. Build & run with:
+ *
+ *   pio run -e explore && .pio/build/explore/program [-d depth] [-dot]
+ *
+ * A state is the state of AlarmFsm, which covers whether the gate is open,
+ * whether the alarm is sounding & the kind of suspension, plus whether a
+ * suspension time is being entered & the number of digits in the time entered
+ * so far. Times with the same number of digits are handled alike, so that's
+ * enough to cover every time. States are packed into a byte, so those seen are
+ * kept in a bit set.
+ *
+ * Every transition's actions are checked against its change of state, e.g. the
+ * alarm is sounded exactly when entering ALARM & a suspension is only ended
+ * when leaving a suspended state. The reachable state graph is printed, as text
+ * or with -dot for Graphviz, followed by any violations of these or of other
+ * invariants, which also set the exit status.
+ * Exploration stops after depth inputs if given, else once no new states are
+ * found.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Arduino.h"
+#include "alarm_fsm.h"
+#include "suspend_entry.h"
+
+// Inputs: digits 0 to 9 then these
+#define INPUT_HASH            10
+#define INPUT_STAR            11
+#define INPUT_GATE_OPENED     12
+#define INPUT_TIMEOUT         13
+#define INPUT_COUNT           14
+
+// Bits of a packed state: AlarmFsm state, then whether entering, then digits
+#define STATE_BITS            7
+#define PACKED_STATE_COUNT    (1 << STATE_BITS)
+
+struct ControllerState {
+  AlarmFsm fsm;
+  SuspendEntry entry;
+};
+
+struct Edge {
+  byte from;
+  byte input;
+  byte to;
+};
+
+static const char *const STATE_NAMES[STATE_COUNT] = {
+  "ARMED", "ALARM", "SUSPENDED", "SUSPENDED_FOREVER", "SUSPENDED_OPEN", "SUSPENDED_FOREVER_OPEN"
+};
+
+static const char *const INPUT_NAMES[INPUT_COUNT] = {
+  "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "#", "*", "gate opened", "timeout"
+};
+
+static std::vector<ControllerState> states;
+static std::vector<unsigned int> depths;
+static std::vector<Edge> edges;
+// Index in states of each packed state seen, if its bit is set
+static byte seen[PACKED_STATE_COUNT / 8];
+static byte indexOf[PACKED_STATE_COUNT];
+static unsigned int violations = 0;
+
+static byte digitCount(unsigned int minutes) {
+  byte digits = 0;
+  for (; minutes > 0; minutes /= SUSPEND_ENTRY_BASE) {
+    digits++;
+  }
+  return digits;
+}
+
+static byte pack(const ControllerState &s) {
+  byte digits = s.entry.isEntering() ? digitCount(s.entry.minutes()) : 0;
+  return s.fsm.state() | (s.entry.isEntering() << 3) | (digits << 4);
+}
+
+static boolean isSeen(byte packed) {
+  return seen[packed / 8] & _BV(packed % 8);
+}
+
+static void describe(char *buffer, size_t size, const ControllerState &s) {
+  if (s.entry.isEntering()) {
+    byte digits = digitCount(s.entry.minutes());
+    snprintf(buffer, size, "%s, entering %s", STATE_NAMES[s.fsm.state()],
+      digits == 0 ? "0" : digits == 1 ? "1 digit" : digits == 2 ? "2 digits" : digits == 3 ? "3 digits" : "4 digits");
+  }
+  else {
+    snprintf(buffer, size, "%s", STATE_NAMES[s.fsm.state()]);
+  }
+}
+
+static void violation(const ControllerState &s, const char *input, const char *message) {
+  char name[64];
+  describe(name, sizeof(name), s);
+  if (input) {
+    fprintf(stderr, "VIOLATION in %s on %s: %s\n", name, input, message);
+  }
+  else {
+    fprintf(stderr, "VIOLATION in %s: %s\n", name, message);
+  }
+  violations++;
+}
+
+// Checks invariants of a state
+static void check(const ControllerState &s) {
+  if (s.entry.minutes() > MAX_SUSPEND_MINUTES) {
+    violation(s, NULL, "suspension time entered out of range");
+  }
+}
+
+// Checks that a transition's actions match its change of state, as the
+// actions are what drive the outputs. A suspension may be restarted while
+// already suspended.
+static void checkActions(const ControllerState &before, const ControllerState &after, const char *input, byte actions) {
+  boolean wasSounding = before.fsm.state() == STATE_ALARM;
+  boolean isSounding = after.fsm.state() == STATE_ALARM;
+  boolean wasSuspended = before.fsm.isSuspended();
+  boolean isSuspended = after.fsm.isSuspended();
+  if (((actions & ACTION_SOUND_ALARM) != 0) != (isSounding && !wasSounding)) {
+    violation(before, input, "alarm must be sounded exactly when entering ALARM");
+  }
+  if (((actions & ACTION_SILENCE_ALARM) != 0) != (wasSounding && !isSounding)) {
+    violation(before, input, "alarm must be silenced exactly when leaving ALARM");
+  }
+  if ((actions & ACTION_START_SUSPENSION) ? !isSuspended : (isSuspended && !wasSuspended)) {
+    violation(before, input, "suspension must be started when, and only when, entering a suspended state");
+  }
+  if (((actions & ACTION_END_SUSPENSION) != 0) != (wasSuspended && !isSuspended)) {
+    violation(before, input, "suspension must be ended exactly when leaving a suspended state");
+  }
+}
+
+// Applies an input as main.cpp does. Returns false if it isn't possible in the
+// state. Illegal events are reported.
+static boolean apply(ControllerState &s, byte input) {
+  byte event;
+  if (input < SUSPEND_ENTRY_BASE) {
+    s.entry.addDigit(input);
+    return true;
+  }
+  switch (input) {
+    case INPUT_HASH:
+      event = s.entry.finish();
+      break;
+    case INPUT_STAR:
+      event = EVENT_RESET;
+      break;
+    case INPUT_GATE_OPENED:
+      event = EVENT_GATE_OPENED;
+      break;
+    default:
+      // The suspension timeout task only runs during a timed suspension
+      if (!s.fsm.isSuspended() || s.fsm.isSuspendedForever()) {
+        return false;
+      }
+      event = EVENT_SUSPENSION_TIMEOUT;
+      break;
+  }
+  ControllerState before = s;
+  byte actions = s.fsm.dispatch(event);
+  if (actions == ACTION_ILLEGAL) {
+    violation(before, INPUT_NAMES[input], "illegal event");
+  }
+  else {
+    checkActions(before, s, INPUT_NAMES[input], actions);
+  }
+  return true;
+}
+
+// Adds a state if it hasn't been seen. Returns its index.
+static byte add(const ControllerState &s, unsigned int depth) {
+  byte packed = pack(s);
+  if (!isSeen(packed)) {
+    seen[packed / 8] |= _BV(packed % 8);
+    indexOf[packed] = states.size();
+    states.push_back(s);
+    depths.push_back(depth);
+    check(s);
+  }
+  return indexOf[packed];
+}
+
+static void explore(unsigned int maxDepth) {
+  add(ControllerState(), 0);
+  for (size_t i = 0; i < states.size(); i++) {
+    if (depths[i] >= maxDepth) {
+      continue;
+    }
+    for (byte input = 0; input < INPUT_COUNT; input++) {
+      ControllerState next = states[i];
+      if (apply(next, input)) {
+        edges.push_back({(byte) i, input, add(next, depths[i] + 1)});
+      }
+    }
+  }
+}
+
+// Checks that every state of AlarmFsm is reachable & that start up is
+// reachable from every state, so none is a trap
+static void checkGraph() {
+  boolean reached[STATE_COUNT] = {};
+  for (const ControllerState &s : states) {
+    reached[s.fsm.state()] = true;
+  }
+  for (byte state = 0; state < STATE_COUNT; state++) {
+    if (!reached[state]) {
+      fprintf(stderr, "VIOLATION: %s unreachable\n", STATE_NAMES[state]);
+      violations++;
+    }
+  }
+
+  std::vector<boolean> reachesStart(states.size(), false);
+  reachesStart[0] = true;
+  boolean changed = true;
+  while (changed) {
+    changed = false;
+    for (const Edge &edge : edges) {
+      if (reachesStart[edge.to] && !reachesStart[edge.from]) {
+        reachesStart[edge.from] = true;
+        changed = true;
+      }
+    }
+  }
+  for (size_t i = 0; i < states.size(); i++) {
+    if (!reachesStart[i]) {
+      violation(states[i], NULL, "start up state unreachable from here");
+    }
+  }
+}
+
+static void printGraph(boolean dot) {
+  char name[64];
+  if (dot) {
+    printf("digraph controller {\n");
+    for (size_t i = 0; i < states.size(); i++) {
+      describe(name, sizeof(name), states[i]);
+      printf("  s%u [label=\"%s\"];\n", (unsigned int) i, name);
+    }
+  }
+  else {
+    for (size_t i = 0; i < states.size(); i++) {
+      describe(name, sizeof(name), states[i]);
+      printf("s%-3u depth %u  %s\n", (unsigned int) i, depths[i], name);
+    }
+    printf("\n");
+  }
+  for (const Edge &edge : edges) {
+    if (edge.to == edge.from) {
+      continue;
+    }
+    if (dot) {
+      printf("  s%u -> s%u [label=\"%s\"];\n", edge.from, edge.to, INPUT_NAMES[edge.input]);
+    }
+    else {
+      printf("s%-3u --%s--> s%u\n", edge.from, INPUT_NAMES[edge.input], edge.to);
+    }
+  }
+  if (dot) {
+    printf("}\n");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int maxDepth = (unsigned int) -1;
+  boolean dot = false;
+  for (int arg = 1; arg < argc; arg++) {
+    if (strcmp(argv[arg], "-d") == 0 && arg + 1 < argc) {
+      maxDepth = strtoul(argv[++arg], NULL, 10);
+    }
+    else if (strcmp(argv[arg], "-dot") == 0) {
+      dot = true;
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-d depth] [-dot]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  explore(maxDepth);
+  if (maxDepth == (unsigned int) -1) {
+    checkGraph();
+  }
+  printGraph(dot);
+
+  unsigned int depth = 0;
+  for (unsigned int d : depths) {
+    if (d > depth) {
+      depth = d;
+    }
+  }
+  fprintf(stderr, "%u states, %u transitions, depth %u, %u violations\n",
+    (unsigned int) states.size(), (unsigned int) edges.size(), depth, violations);
+  return violations > 0 ? 1 : 0;
+}
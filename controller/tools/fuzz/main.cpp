@@ -0,0 +1,490 @@
+/*
+ * main.cpp
+ *
+ * Fuzzes the controller firmware's input handling on the host. Each input is a
+ * string of bytes, decoded as a sequence of key presses, zone changes, supply
+ * voltage changes & clock advances, which are applied to the firmware on the
+ * simulated MCU. The same inputs drive a model of what the user should see,
+ * independent of the firmware's own state, and after every pass of loop() the
+ * buzzer, alarm LED & display are checked against it: the buzzer pulses exactly
+ * when a debounced zone has opened since the last reset & no suspension is
+ * running, a timed suspension ends within the minutes entered, and so on. Any
+ * violation aborts with a description.
+ *
+ * The entry point is LLVMFuzzerTestOneInput(), so with clang this can be built
+ * against libFuzzer, for coverage guided fuzzing, by compiling the firmware,
+ * native/ & this file with -fsanitize=fuzzer -D FUZZ_LIBFUZZER. Otherwise it
+ * has its own main(), which runs random inputs or replays saved ones:
+ *
+ *   pio run -e fuzz && .pio/build/fuzz/program [-s seed] [-n inputs] [file...]
+ *
+ * With files, each is run as an input. Otherwise -n random inputs are run,
+ * default 10000, and one that violates an invariant is saved to crash.bin.
+ *
+ * The firmware can't be restarted, so inputs run one after another on the same
+ * controller. Each starts by closing all zones and entering 0# & * on the
+ * keypad, which returns the alarm to armed with the gate closed.
+ *
+ * This runs about 11,000 events a second, well short of the millions a second
+ * that were the target. Profiling with gprof puts about 6% of the time in the
+ * checks: the rest goes in simulating the firmware, as an event is on average
+ * over 100 passes of loop(), e.g. one every 250 ms while a suspension counts
+ * down on the display, and the timer interrupts between them.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+
+#include "Arduino.h"
+#include "sim.h"
+#include "alarm_fsm.h"
+#include "suspend_entry.h"
+#include "zone_monitor.h"
+
+// Must match main.cpp
+#define ALARM_BUZZER_PIN        10
+#define ALARM_LED_PIN           11
+#define MILLIS_PER_MINUTE       60000UL
+#define DISPLAY_UPDATE_DELTA    250
+
+// Firmware state, only shown when an invariant is violated
+extern AlarmFsm alarmFsm;
+extern byte openedZones;
+extern SuspendEntry suspendEntry;
+
+// Time allowed for start up in ms
+#define WARM_UP_TIME            5000
+
+// Time a zone must stay open or closed to be sure it's debounced, in ms
+#define ZONE_SETTLE_TIME        100
+
+// A zone that opens or closes for less than this many ms is sure to be ignored
+// by the debouncing: 3 sample intervals. It takes 4 samples in a row to change
+// the debounced state, so a change that lasts from 3 to 4 intervals may or may
+// not be seen.
+#define ZONE_IGNORED_TIME       (3 * ZONE_SAMPLE_INTERVAL)
+
+// Changes closer together than this many ms may both fall between two samples,
+// so which of them the debouncing sees can't be known. One sample interval,
+// plus a tick as a sample & a change may be at the same time.
+#define ZONE_UNSAMPLED_TIME     (ZONE_SAMPLE_INTERVAL + 1)
+
+// Time the clock is advanced after each key press, which is enough for the
+// firmware to act on it, in ms
+#define KEY_PRESS_TIME          20
+
+// Time allowed for the outputs to follow an input or a suspension timing out,
+// in ms
+#define OUTPUT_SETTLE_TIME      100
+
+// Longest the buzzer & alarm LED stay in one state while they pulse, plus one
+// tick
+#define BUZZER_MAX_STEP         1501
+#define ALARM_LED_MAX_STEP      1251
+
+// Largest input run by main()
+#define MAX_INPUT_SIZE          256
+
+// Operations, in the top 3 bits of each byte of an input. The other 5 bits are
+// the operation's argument.
+#define OP_DIGIT                0   // digit key, argument mod 10
+#define OP_HASH                 1
+#define OP_STAR                 2
+#define OP_ZONES                3   // zones open, as a mask
+#define OP_WAIT_MILLIS          4   // advance clock by argument ms
+#define OP_WAIT_SECONDS         5   // advance clock by argument s
+#define OP_WAIT_MINUTES         6   // advance clock by argument minutes
+#define OP_SUPPLY               7   // supply voltage 3500 mV + argument * 50
+
+// Suspensions in the model
+#define SUSPENSION_NONE         0
+#define SUSPENSION_TIMED        1
+#define SUSPENSION_FOREVER      2
+
+// Model of what the outputs should show, worked out from the inputs alone, as
+// the user guide describes them, so it shares nothing with the firmware's
+// AlarmFsm or SuspendEntry. Where the order in which the firmware sees two
+// inputs close together can't be known, the model gives up on whether the gate
+// is open until the next reset that's clear of any zone changes.
+static boolean isEntering = false;
+static unsigned int enteredMinutes = 0;
+static byte suspension = SUSPENSION_NONE;
+static uint64_t suspendedUntil = 0;
+static boolean isGateOpen = false;
+static boolean isGateKnown = true;
+static uint64_t lastResetAt = 0;
+// Time of the last input or time out, which the outputs may take a while to
+// follow
+static uint64_t changedAt = 0;
+
+// Zones as input, as the debouncing last surely saw them, and whether that's
+// known, as masks, and times each zone's input last changed
+static byte zoneMask = 0;
+static byte debouncedMask = 0;
+static byte knownMask = 0xFF;
+static uint64_t zoneChangedAt[ZONE_COUNT];
+
+static uint64_t lastBuzzerChange = 0;
+static uint64_t lastAlarmLEDChange = 0;
+
+static unsigned long events = 0;
+
+// Input being run by main(), saved if it fails
+static const uint8_t *currentInput = NULL;
+static size_t currentSize = 0;
+
+static void fail(const char *invariant) {
+  fprintf(stderr, "%lu ms: invariant violated: %s\n", (unsigned long) sim::nowMillis(), invariant);
+  fprintf(stderr, "  model: suspension %d until %lu, gate %s, entry %ld, zones 0x%02X\n",
+    suspension, (unsigned long) suspendedUntil, isGateKnown ? (isGateOpen ? "open" : "closed") : "unknown",
+    isEntering ? (long) enteredMinutes : -1L, zoneMask);
+  fprintf(stderr, "  firmware: state %d, opened zones 0x%02X, entry %ld\n",
+    alarmFsm.state(), openedZones, suspendEntry.isEntering() ? (long) suspendEntry.minutes() : -1L);
+  fprintf(stderr, "  LCD: \"%s\" / \"%s\"\n", sim::lcd().line(0).c_str(), sim::lcd().line(1).c_str());
+  if (currentInput) {
+    FILE *crash = fopen("crash.bin", "wb");
+    if (crash) {
+      fwrite(currentInput, 1, currentSize, crash);
+      fclose(crash);
+      fprintf(stderr, "Input saved to crash.bin\n");
+    }
+  }
+  abort();
+}
+
+// A zone may have opened, as far as the firmware can tell
+static void mayHaveOpened() {
+  if (!isGateOpen) {
+    isGateKnown = false;
+  }
+}
+
+// Whether a zone's debounced state may still change or has been lost
+static boolean isUnsettled(byte i) {
+  byte bit = _BV(i);
+  return !(knownMask & bit) || ((zoneMask ^ debouncedMask) & bit);
+}
+
+// Brings the model up to the given time: zones that have been steady long
+// enough are surely debounced, and a timed suspension ends when due
+static void updateModel(uint64_t now) {
+  for (byte i = 0; i < ZONE_COUNT; i++) {
+    byte bit = _BV(i);
+    if (!isUnsettled(i) || now < zoneChangedAt[i] + ZONE_SETTLE_TIME) {
+      continue;
+    }
+    if ((knownMask & bit) && (zoneMask & bit)) {
+      // Surely opened, but not surely before or after a reset since
+      if (lastResetAt >= zoneChangedAt[i]) {
+        mayHaveOpened();
+      }
+      else {
+        isGateOpen = true;
+        isGateKnown = true;
+      }
+    }
+    knownMask |= bit;
+    debouncedMask = (debouncedMask & ~bit) | (zoneMask & bit);
+  }
+  if (suspension == SUSPENSION_TIMED && now >= suspendedUntil) {
+    suspension = SUSPENSION_NONE;
+    changedAt = suspendedUntil;
+  }
+}
+
+static void setZones(byte mask) {
+  uint64_t now = sim::nowMillis();
+  updateModel(now);
+  for (byte i = 0; i < ZONE_COUNT; i++) {
+    byte bit = _BV(i);
+    if (!((mask ^ zoneMask) & bit)) {
+      continue;
+    }
+    if (!(knownMask & bit)) {
+      if (mask & bit) {
+        mayHaveOpened();
+      }
+    }
+    else if (now < zoneChangedAt[i] + ZONE_UNSAMPLED_TIME) {
+      // The zone may have been in either state at every sample since the last
+      // change but one, so what the debouncing has made of it is lost
+      knownMask &= ~bit;
+      mayHaveOpened();
+    }
+    else if (!((mask ^ debouncedMask) & bit) && now >= zoneChangedAt[i] + ZONE_IGNORED_TIME) {
+      // Back to the debounced state, but maybe not soon enough to be ignored
+      knownMask &= ~bit;
+      mayHaveOpened();
+    }
+    zoneChangedAt[i] = now;
+    sim::setPin(ZoneMonitor::PINS[i], (mask & bit) ? LOW : HIGH);
+  }
+  zoneMask = mask;
+}
+
+static void pressKey(char key) {
+  uint64_t now = sim::nowMillis();
+  updateModel(now);
+  if (key >= '0' && key <= '9') {
+    unsigned int minutes = (isEntering ? enteredMinutes * 10 : 0) + (key - '0');
+    if (minutes <= MAX_SUSPEND_MINUTES) {
+      enteredMinutes = minutes;
+    }
+    isEntering = true;
+  }
+  else if (key == '#') {
+    if (!isEntering) {
+      suspension = SUSPENSION_FOREVER;
+    }
+    else if (enteredMinutes > 0) {
+      suspension = SUSPENSION_TIMED;
+      suspendedUntil = now + enteredMinutes * MILLIS_PER_MINUTE;
+    }
+    else {
+      suspension = SUSPENSION_NONE;
+    }
+    isEntering = false;
+  }
+  else if (key == '*') {
+    suspension = SUSPENSION_NONE;
+    isGateOpen = false;
+    isGateKnown = true;
+    lastResetAt = now;
+    for (byte i = 0; i < ZONE_COUNT; i++) {
+      if (isUnsettled(i)) {
+        mayHaveOpened();
+      }
+    }
+  }
+  changedAt = now;
+  sim::pressKey(key);
+  sim::runFor(KEY_PRESS_TIME);
+}
+
+// LCD line without the spaces that centre it
+static std::string lcdLine(byte row) {
+  std::string line = sim::lcd().line(row);
+  size_t first = line.find_first_not_of(' ');
+  if (first == std::string::npos) {
+    return "";
+  }
+  return line.substr(first, line.find_last_not_of(' ') + 1 - first);
+}
+
+static void checkDisplay(uint64_t now) {
+  std::string top = lcdLine(0);
+  std::string bottom = lcdLine(1);
+  if (isEntering) {
+    if (top != "Enter delay:" || bottom != std::to_string(enteredMinutes)) {
+      fail("display shows minutes entered");
+    }
+  }
+  else if (suspension == SUSPENSION_TIMED) {
+    // Shows whole seconds left when last updated, which can be a display
+    // update & key press later than the model's
+    unsigned int minutes, seconds;
+    if (top != "Alarm paused for" || sscanf(bottom.c_str(), "%u:%u", &minutes, &seconds) != 2) {
+      fail("display shows suspension time left");
+    }
+    uint64_t shown = (minutes * 60UL + seconds) * 1000;
+    uint64_t left = suspendedUntil - now;
+    if (seconds >= 60 || shown + 1000 <= left || shown > left + KEY_PRESS_TIME + DISPLAY_UPDATE_DELTA + OUTPUT_SETTLE_TIME) {
+      fail("suspension time left shown is within the minutes entered");
+    }
+  }
+  else if (suspension == SUSPENSION_FOREVER) {
+    if (top != "Alarm" || bottom != "Suspended") {
+      fail("display shows suspended");
+    }
+  }
+  else if (isGateKnown) {
+    if (isGateOpen ? (top != "** GATE **" || bottom.find("OPEN:") != 0) : (top != "OK" || !bottom.empty())) {
+      fail("display shows whether gate open");
+    }
+  }
+}
+
+// Checks the outputs against the model, once they've had time to follow the
+// inputs
+static void checkInvariants() {
+  uint64_t now = sim::nowMillis();
+  if (alarmFsm.illegalCount() != 0) {
+    fail("no illegal events");
+  }
+  if (sim::ignoredKeyCount() != 0) {
+    fail("every key pressed is read");
+  }
+  updateModel(now);
+  if (now < changedAt + OUTPUT_SETTLE_TIME) {
+    return;
+  }
+  for (byte i = 0; i < ZONE_COUNT; i++) {
+    if (isUnsettled(i)) {
+      return;
+    }
+  }
+  if (isGateKnown) {
+    boolean isSounding = isGateOpen && suspension == SUSPENSION_NONE;
+    if (isSounding) {
+      if (now > lastBuzzerChange + BUZZER_MAX_STEP) {
+        fail("buzzer pulses while a zone has opened & alarm not suspended");
+      }
+    }
+    else if (sim::pinLevel(ALARM_BUZZER_PIN) != LOW) {
+      fail("buzzer off unless a zone has opened & alarm not suspended");
+    }
+    if (isGateOpen) {
+      if (now > lastAlarmLEDChange + ALARM_LED_MAX_STEP) {
+        fail("alarm LED pulses while a zone has opened");
+      }
+    }
+    else if (sim::pinLevel(ALARM_LED_PIN) != LOW) {
+      fail("alarm LED off unless a zone has opened");
+    }
+  }
+  if (sim::isI2CIdle()) {
+    checkDisplay(now);
+  }
+}
+
+static void run(byte op) {
+  byte arg = op & 0x1F;
+  events++;
+  switch (op >> 5) {
+    case OP_DIGIT:
+      pressKey('0' + arg % 10);
+      break;
+    case OP_HASH:
+      pressKey('#');
+      break;
+    case OP_STAR:
+      pressKey('*');
+      break;
+    case OP_ZONES:
+      setZones(arg);
+      sim::runFor(1);
+      break;
+    case OP_WAIT_MILLIS:
+      sim::runFor(arg + 1);
+      break;
+    case OP_WAIT_SECONDS:
+      sim::runFor((arg + 1) * 1000UL);
+      break;
+    case OP_WAIT_MINUTES:
+      sim::runFor((arg + 1) * MILLIS_PER_MINUTE);
+      break;
+    case OP_SUPPLY:
+      sim::setSupplyVoltage(3500 + arg * 50);
+      sim::runFor(1);
+      break;
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static boolean isStarted = false;
+  if (!isStarted) {
+    isStarted = true;
+    sim::setSerialOutput(NULL);
+    sim::onPinChange([](uint8_t pin, uint8_t) {
+      if (pin == ALARM_BUZZER_PIN) {
+        lastBuzzerChange = sim::nowMillis();
+      }
+      else if (pin == ALARM_LED_PIN) {
+        lastAlarmLEDChange = sim::nowMillis();
+      }
+    });
+    sim::begin();
+    sim::runFor(WARM_UP_TIME);
+    sim::onLoop(checkInvariants);
+  }
+
+  setZones(0);
+  sim::setSupplyVoltage(5000);
+  sim::runFor(ZONE_SETTLE_TIME);
+  pressKey('0');
+  pressKey('#');
+  pressKey('*');
+  sim::runFor(ZONE_SETTLE_TIME);
+  if (!isGateKnown) {
+    fail("input starts with gate closed");
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    run(data[i]);
+  }
+  return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+static uint32_t randomState;
+
+// xorshift32
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long seed = 1;
+  unsigned long count = 10000;
+  int arg = 1;
+  for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+    if (strcmp(argv[arg], "-s") == 0) {
+      seed = strtoul(argv[arg + 1], NULL, 0);
+    }
+    else if (strcmp(argv[arg], "-n") == 0) {
+      count = strtoul(argv[arg + 1], NULL, 0);
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-s seed] [-n inputs] [file...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  clock_t started = clock();
+  unsigned long inputs = 0;
+  if (arg < argc) {
+    for (; arg < argc; arg++) {
+      static uint8_t data[65536];
+      FILE *file = fopen(argv[arg], "rb");
+      if (file == NULL) {
+        perror(argv[arg]);
+        return 1;
+      }
+      size_t size = fread(data, 1, sizeof(data), file);
+      fclose(file);
+      LLVMFuzzerTestOneInput(data, size);
+      inputs++;
+    }
+  }
+  else {
+    randomState = seed ? seed : 1;
+    uint8_t data[MAX_INPUT_SIZE];
+    for (; inputs < count; inputs++) {
+      size_t size = 1 + nextRandom() % MAX_INPUT_SIZE;
+      for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t) nextRandom();
+      }
+      currentInput = data;
+      currentSize = size;
+      LLVMFuzzerTestOneInput(data, size);
+    }
+  }
+  double seconds = (double) (clock() - started) / CLOCKS_PER_SEC;
+
+  printf(
+    "%lu inputs, %lu events, %lu loop passes, %.1f days simulated in %.1f s (%.0f events/s)\n",
+    inputs, events, sim::loopCount(), sim::nowMillis() / 86400000.0, seconds,
+    events / (seconds > 0 ? seconds : 1e-9)
+  );
+  return 0;
+}
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * main.cpp
+ *
+ * Converts debug output written with DEBUG_TOKENS defined back to text. Binary
+ * log records, see log.h, are replaced by their message, prefixed by the time
+ * in seconds. All other output is copied unchanged. Build & run with:
+ *
+ *   pio run -e log_decode
+ *   .pio/build/log_decode/program [file]
+ *
+ * Reads from the given file, e.g. a serial device, or from stdin.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "log.h"
+
+static const char *FORMATS[] = {
+#define LOG_MESSAGE(name, format) format,
+#include "log_messages.def"
+#undef LOG_MESSAGE
+};
+
+static FILE *input;
+
+// Bytes read but not consumed, returned before any more are read
+static std::deque<int> pending;
+
+static int next() {
+  if (!pending.empty()) {
+    int c = pending.front();
+    pending.pop_front();
+    return c;
+  }
+  return fgetc(input);
+}
+
+static int argumentCount(const char *format) {
+  int count = 0;
+  for (const char *p = format; *p; p++) {
+    if (*p == '%') {
+      if (p[1] == '%') {
+        p++;
+      }
+      else {
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+static bool readVarint(std::vector<int> &raw, unsigned long &value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int c = next();
+    if (c == EOF) {
+      return false;
+    }
+    raw.push_back(c);
+    value |= (unsigned long) (c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reads the rest of a record after LOG_RECORD_START. Bytes read are added to
+// raw, so they can be put back if the record isn't valid.
+static bool readRecord(std::vector<int> &raw, std::string &text) {
+  int id = next();
+  if (id == EOF || id >= LOG_MESSAGE_COUNT) {
+    if (id != EOF) {
+      raw.push_back(id);
+    }
+    return false;
+  }
+  raw.push_back(id);
+  const char *format = FORMATS[id];
+  unsigned long time;
+  if (!readVarint(raw, time)) {
+    return false;
+  }
+  long args[LOG_MAX_ARGS];
+  int argc = argumentCount(format);
+  for (int i = 0; i < argc; i++) {
+    unsigned long zigzag;
+    if (!readVarint(raw, zigzag)) {
+      return false;
+    }
+    zigzag &= 0xFFFFFFFFUL;
+    args[i] = (long) (int32_t) ((zigzag >> 1) ^ -(zigzag & 1));
+  }
+  int checksum = next();
+  if (checksum == EOF) {
+    return false;
+  }
+  int expected = 0;
+  for (int c : raw) {
+    expected ^= c;
+  }
+  raw.push_back(checksum);
+  if (checksum != expected) {
+    return false;
+  }
+
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%10.3f  ", (time & 0xFFFFFFFFUL) / 1000.0);
+  text = buffer;
+  int argIndex = 0;
+  for (const char *p = format; *p; p++) {
+    if (*p != '%') {
+      text += *p;
+    }
+    else if (p[1] == '%') {
+      text += '%';
+      p++;
+    }
+    else {
+      text += std::to_string(args[argIndex++]);
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  input = stdin;
+  if (argc > 1) {
+    input = fopen(argv[1], "rb");
+    if (!input) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+  int c;
+  while ((c = next()) != EOF) {
+    if (c != LOG_RECORD_START) {
+      putchar(c);
+      continue;
+    }
+    std::vector<int> raw;
+    std::string text;
+    if (readRecord(raw, text)) {
+      puts(text.c_str());
+    }
+    else {
+      // Not a record after all: carry on from the byte after the start
+      printf("<bad record>\n");
+      pending.insert(pending.begin(), raw.begin(), raw.end());
+    }
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * main.cpp
+ *
+ * Replays a trace of inputs against the controller firmware on the host and
+ * prints a trace of the outputs, so that the behaviour of two versions of the
+ * firmware can be compared by diffing their output traces. Build & run with:
+ *
+ *   pio run -e replay && .pio/build/replay/program [-v] [trace]
+ *
+ * The trace is read from the given file or from standard input. Each input is
+ * a line starting with @ and the time in ms since start up:
+ *
+ *   @10000 zones 1       zones open, as a mask: zone n is bit n - 1
+ *   @35000 key 42        key pressed, as an ASCII code
+ *   @50000 keys 1#       keys pressed in turn, as typed
+ *   @70000 supply 4200   supply voltage in mV
+ *
+ * Anything before the @ and any line without one is ignored. The firmware
+ * logs zone changes & keys in this form when built with DEBUG, so the serial
+ * output of a real unit, decoded by tools/log_decode if tokenized, is a trace
+ * as it stands. Zone changes are logged once debounced, so replayed ones are
+ * seen a debounce time later than on the unit.
+ *
+ * Output pins are printed as they change and the LCD whenever its text or
+ * backlight changes, once the I2C bus is idle. The replay runs for
+ * REPLAY_TAIL_TIME after the last input. The speed of the replay relative to
+ * real time is printed to standard error. -v also shows the firmware's debug
+ * output on standard error.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+#include "Arduino.h"
+#include "sim.h"
+#include "zone_monitor.h"
+
+// Must match main.cpp
+#define ALARM_BUZZER_PIN    10
+#define ALARM_LED_PIN       11
+#define HEARTBEAT_LED_PIN   12
+
+// Time replayed after the last input in ms
+#define REPLAY_TAIL_TIME    60000
+
+static std::string shownLcd;
+
+static const char *pinName(uint8_t pin) {
+  switch (pin) {
+    case ALARM_BUZZER_PIN:
+      return "buzzer";
+    case ALARM_LED_PIN:
+      return "alarm-led";
+    case HEARTBEAT_LED_PIN:
+      return "heartbeat-led";
+    default:
+      return NULL;
+  }
+}
+
+static void setZones(unsigned long mask) {
+  for (byte i = 0; i < ZONE_COUNT; i++) {
+    sim::setPin(ZoneMonitor::PINS[i], (mask & (1 << i)) ? LOW : HIGH);
+  }
+}
+
+static void showLcdIfChanged() {
+  if (!sim::isI2CIdle()) {
+    return;
+  }
+  LcdEmulator &lcd = sim::lcd();
+  std::string text = "|" + lcd.line(0) + "|" + lcd.line(1) + "|";
+  if (!lcd.isBacklightOn()) {
+    text += " dark";
+  }
+  if (text != shownLcd) {
+    shownLcd = text;
+    printf("%8lu lcd %s\n", (unsigned long) sim::nowMillis(), text.c_str());
+  }
+}
+
+// Schedules the input on a line of a trace. Returns its time, or 0 if there
+// isn't one.
+static unsigned long scheduleInput(const char *line, unsigned long lineNumber) {
+  const char *at = strchr(line, '@');
+  if (at == NULL) {
+    return 0;
+  }
+  char *end;
+  unsigned long time = strtoul(at + 1, &end, 10);
+  if (end == at + 1) {
+    return 0;
+  }
+  char kind[16];
+  char value[64];
+  if (sscanf(end, " %15s %63s", kind, value) != 2) {
+    fprintf(stderr, "Line %lu: missing input\n", lineNumber);
+    exit(1);
+  }
+  std::string keys = value;
+  unsigned long number = strtoul(value, NULL, 10);
+  if (strcmp(kind, "zones") == 0) {
+    sim::at(time, [number]() { setZones(number); });
+  }
+  else if (strcmp(kind, "key") == 0) {
+    sim::at(time, [number]() { sim::pressKey((char) number); });
+  }
+  else if (strcmp(kind, "keys") == 0) {
+    sim::at(time, [keys]() {
+      for (char key : keys) {
+        sim::pressKey(key);
+      }
+    });
+  }
+  else if (strcmp(kind, "supply") == 0) {
+    sim::at(time, [number]() { sim::setSupplyVoltage(number); });
+  }
+  else {
+    fprintf(stderr, "Line %lu: unknown input '%s'\n", lineNumber, kind);
+    exit(1);
+  }
+  return time;
+}
+
+int main(int argc, char *argv[]) {
+  int arg = 1;
+  if (arg < argc && strcmp(argv[arg], "-v") == 0) {
+    sim::setSerialOutput(stderr);
+    arg++;
+  }
+  else {
+    sim::setSerialOutput(NULL);
+  }
+  FILE *trace = stdin;
+  if (arg < argc) {
+    trace = fopen(argv[arg], "r");
+    if (trace == NULL) {
+      perror(argv[arg]);
+      return 1;
+    }
+  }
+
+  char line[256];
+  unsigned long lineNumber = 0;
+  unsigned long lastInput = 0;
+  while (fgets(line, sizeof(line), trace)) {
+    unsigned long time = scheduleInput(line, ++lineNumber);
+    if (time > lastInput) {
+      lastInput = time;
+    }
+  }
+  if (trace != stdin) {
+    fclose(trace);
+  }
+
+  sim::onPinChange([](uint8_t pin, uint8_t level) {
+    const char *name = pinName(pin);
+    if (name) {
+      printf("%8lu %s %d\n", (unsigned long) sim::nowMillis(), name, level);
+    }
+  });
+  sim::onLoop(showLcdIfChanged);
+
+  clock_t started = clock();
+  sim::begin();
+  sim::runUntil(lastInput + REPLAY_TAIL_TIME);
+  double seconds = (double) (clock() - started) / CLOCKS_PER_SEC;
+
+  fprintf(
+    stderr, "Replayed %lu ms in %.3f s (%.0fx real time)\n",
+    (unsigned long) sim::nowMillis(), seconds, sim::nowMillis() / 1000.0 / (seconds > 0 ? seconds : 1e-9)
+  );
+  return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * main.cpp
+ *
+ * Runs the controller firmware on the host through a scripted scenario and
+ * prints what the LCD and outputs are showing every few seconds. Build & run
+ * with:
+ *
+ *   pio run -e native && .pio/build/native/program [-v]
+ *
+ * -v also shows the firmware's debug output.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "sim.h"
+
+// Must match main.cpp
+#define MAGNET_SWITCH_PIN 2
+#define ALARM_BUZZER_PIN  10
+#define ALARM_LED_PIN     11
+#define HEARTBEAT_LED_PIN 12
+
+// Time between snapshots of the outputs in ms
+#define SNAPSHOT_INTERVAL 5000
+
+// Length of scenario in ms
+#define SCENARIO_TIME     180000
+
+static unsigned long buzzerChanges = 0;
+
+static void snapshot() {
+  LcdEmulator &lcd = sim::lcd();
+  printf(
+    "%7lu ms  |%s|%s|  backlight %-3s  alarm LED %d  buzzer %d  heartbeat %d\n",
+    (unsigned long) sim::nowMillis(), lcd.line(0).c_str(), lcd.line(1).c_str(),
+    lcd.isBacklightOn() ? "on" : "off", sim::pinLevel(ALARM_LED_PIN), sim::pinLevel(ALARM_BUZZER_PIN),
+    sim::pinLevel(HEARTBEAT_LED_PIN)
+  );
+}
+
+static void event(const char *description) {
+  printf("%7lu ms  ** %s\n", (unsigned long) sim::nowMillis(), description);
+}
+
+static void keys(const char *description, const char *pressed) {
+  event(description);
+  for (const char *key = pressed; *key; key++) {
+    sim::pressKey(*key);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || strcmp(argv[1], "-v") != 0) {
+    sim::setSerialOutput(NULL);
+  }
+  sim::onPinChange([](uint8_t pin, uint8_t) {
+    if (pin == ALARM_BUZZER_PIN) {
+      buzzerChanges++;
+    }
+  });
+
+  sim::at(10000, []() { event("gate opened"); sim::setPin(MAGNET_SWITCH_PIN, LOW); });
+  sim::at(30000, []() { event("gate closed"); sim::setPin(MAGNET_SWITCH_PIN, HIGH); });
+  sim::at(35000, []() { keys("alarm reset", "*"); });
+  sim::at(50000, []() { keys("suspend for 1 minute", "1#"); });
+  sim::at(60000, []() { event("gate opened"); sim::setPin(MAGNET_SWITCH_PIN, LOW); });
+  sim::at(90000, []() { event("gate closed"); sim::setPin(MAGNET_SWITCH_PIN, HIGH); });
+  sim::at(140000, []() { keys("alarm reset", "*"); });
+  for (unsigned long t = SNAPSHOT_INTERVAL; t <= SCENARIO_TIME; t += SNAPSHOT_INTERVAL) {
+    sim::at(t, snapshot);
+  }
+
+  sim::begin();
+  sim::runUntil(SCENARIO_TIME);
+
+  printf(
+    "\n%lu loop passes, %lu buzzer changes, %lu I2C transmissions (%lu bytes), %lu LCD clears, "
+    "%lu LCD timing violations\n",
+    sim::loopCount(), buzzerChanges, sim::i2cTransmissions(), sim::i2cBytes(), sim::lcd().clearCount(),
+    sim::lcd().timingViolationCount()
+  );
+  return 0;
+}
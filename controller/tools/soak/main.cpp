@@ -0,0 +1,454 @@
+/*
+ * main.cpp
+ *
+ * Soak test: runs the controller firmware on the host for years of simulated
+ * time, with random but plausible daily use, to find problems that only show
+ * after a unit has run unattended for months. Build & run with:
+ *
+ *   pio run -e soak && .pio/build/soak/program [-y years] [-s seed] [-v]
+ *
+ * Each day has a few visits between 07:00 & 22:00: gate openings with or
+ * without a timed suspension entered first, indefinite suspensions over
+ * several openings, and fumbled entries on the keypad. Zones bounce as they
+ * open & close and some days the supply sags below the low battery level. A
+ * year crosses millis() rollover 7 times and micros() rollover every 71.6
+ * minutes, as millis() & micros() are 32 bits on the host, as on the MCU.
+ *
+ * Checked throughout:
+ *  - loop() runs at least every MAX_LOOP_GAP ms, so no deadline is lost, and
+ *    no more than MAX_DAILY_LOOPS times a day, so doesn't spin
+ *  - a timed suspension ends when it's due & the buzzer pulses while the alarm
+ *    sounds, so neither gets stuck
+ *  - each cycle of the heartbeat LED & the buzzer takes as long as its
+ *    pattern, to within PULSE_TOLERANCE, unless an input or a change of
+ *    state fell within it, so the pulse engine neither gains nor loses ticks
+ * and each day at 04:00, once the visits are over:
+ *  - the alarm is armed, with the gate closed & the buzzer off, and the
+ *    heartbeat LED has flashed within its period
+ *
+ * The simulator's clock is exact & it doesn't stop the timers for power-down,
+ * so this can't measure drift of the real clock, such as from the watchdog's
+ * error in power-down sleep: see power.h.
+ *
+ * -v prints the loop passes & longest loop gap every 30 days. The exit status
+ * is 1 if any check failed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+#include "Arduino.h"
+#include "sim.h"
+#include "alarm_fsm.h"
+#include "suspend_entry.h"
+#include "zone_monitor.h"
+
+// Must match main.cpp
+#define ALARM_BUZZER_PIN        10
+#define HEARTBEAT_LED_PIN       12
+#define BUZZER_PERIOD           2500
+#define HEARTBEAT_PERIOD        8100
+#define LOW_BATTERY_PERIOD      3000
+#define LOW_BATTERY_FLASHES     3
+
+// Firmware state checked, from main.cpp
+extern AlarmFsm alarmFsm;
+extern byte openedZones;
+extern SuspendEntry suspendEntry;
+extern boolean isBatteryLow;
+unsigned long suspendMillisLeft();
+
+#define MILLIS_PER_SECOND       1000UL
+#define MILLIS_PER_MINUTE       60000UL
+#define MILLIS_PER_HOUR         3600000UL
+#define MILLIS_PER_DAY          86400000ULL
+
+// Visits start between these hours
+#define FIRST_VISIT_HOUR        7
+#define LAST_VISIT_HOUR         22
+
+// Hour of the day after that the day's checks are made
+#define CHECK_HOUR              4
+
+// The firmware checks the battery every minute, so is never asleep for long
+#define MAX_LOOP_GAP            (2 * MILLIS_PER_MINUTE)
+
+// Most passes of loop() expected in a day, about 30 times as many as usual.
+// More means the firmware isn't sleeping, which ends the run as it may be
+// stuck at one time.
+#define MAX_DAILY_LOOPS         1000000UL
+
+// Time allowed for an input to reach the firmware, through debouncing or
+// keypad scanning, in ms
+#define INPUT_SETTLE_TIME       1000
+
+// Time between key presses in ms
+#define KEY_INTERVAL            400
+
+// Longest the buzzer stays in one state while the alarm sounds, plus one tick
+#define BUZZER_MAX_STEP         1501
+
+// Time allowed for a suspension to time out once it's due in ms
+#define TIMEOUT_SLACK           2
+
+// Error allowed in a pulse cycle in ms: one tick of the pulse engine
+#define PULSE_TOLERANCE         1
+
+// Days between stats printed with -v
+#define REPORT_INTERVAL         30
+
+#define MAX_YEARS               5
+
+// Most times a pulsed output goes high in a cycle of its pattern
+#define MAX_PULSES              LOW_BATTERY_FLASHES
+
+// Cycles of a pulsed output
+struct PulseCycles {
+  const char *name;
+  // Pattern being checked: its period, the number of pulses in a cycle & the
+  // state of AlarmFsm, as any event restarts the heartbeat pattern
+  unsigned long period;
+  byte pulses;
+  byte state;
+  // Times it last went high, latest first, and how many of those are known
+  uint64_t rises[MAX_PULSES + 1];
+  byte riseCount;
+  // Number of cycles checked
+  unsigned long checked;
+};
+
+static PulseCycles heartbeatCycles = {"heartbeat", 0, 0, 0, {}, 0, 0};
+static PulseCycles buzzerCycles = {"buzzer", 0, 0, 0, {}, 0, 0};
+
+static uint32_t randomState;
+
+static unsigned long failures = 0;
+static unsigned long visits = 0;
+static unsigned long keyPresses = 0;
+static unsigned long zoneChanges = 0;
+
+static uint64_t lastInputAt = 0;
+static uint64_t lastLoopAt = 0;
+static uint64_t maxLoopGap = 0;
+static unsigned long dailyLoops = 0;
+static uint64_t lastBuzzerChange = 0;
+static uint64_t dueSince = 0;
+static boolean isDue = false;
+
+// xorshift32
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+// Random number from min to max inclusive
+static uint32_t randomBetween(uint32_t min, uint32_t max) {
+  return min + nextRandom() % (max - min + 1);
+}
+
+static boolean chance(unsigned int percent) {
+  return nextRandom() % 100 < percent;
+}
+
+static void fail(const char *check) {
+  uint64_t now = sim::nowMillis();
+  fprintf(stderr, "day %lu %02u:%02u:%02u.%03u: %s\n", (unsigned long) (now / MILLIS_PER_DAY),
+    (unsigned int) (now / MILLIS_PER_HOUR % 24), (unsigned int) (now / MILLIS_PER_MINUTE % 60),
+    (unsigned int) (now / MILLIS_PER_SECOND % 60), (unsigned int) (now % MILLIS_PER_SECOND), check);
+  fprintf(stderr, "  state %d, opened zones 0x%02X, entry %ld\n",
+    alarmFsm.state(), openedZones, suspendEntry.isEntering() ? (long) suspendEntry.minutes() : -1L);
+  failures++;
+}
+
+// Inputs
+
+static void inputAt(uint64_t ms, std::function<void()> action) {
+  sim::at(ms, [action]() {
+    lastInputAt = sim::nowMillis();
+    action();
+  });
+}
+
+static void setZones(byte mask) {
+  for (byte i = 0; i < ZONE_COUNT; i++) {
+    sim::setPin(ZoneMonitor::PINS[i], (mask & _BV(i)) ? LOW : HIGH);
+  }
+  zoneChanges++;
+}
+
+// Changes zones at the given time, bouncing a few times first. Returns the
+// time they've settled.
+static uint64_t zonesAt(uint64_t ms, byte from, byte to) {
+  byte bounces = randomBetween(0, 3) * 2;
+  for (byte i = 0; i < bounces; i++) {
+    byte mask = (i & 1) ? from : to;
+    inputAt(ms, [mask]() { setZones(mask); });
+    ms += randomBetween(1, 10);
+  }
+  inputAt(ms, [to]() { setZones(to); });
+  return ms;
+}
+
+// Presses keys in turn from the given time. Returns the time of the last.
+static uint64_t keysAt(uint64_t ms, const std::string &keys) {
+  for (size_t i = 0; i < keys.size(); i++, ms += KEY_INTERVAL) {
+    char key = keys[i];
+    inputAt(ms, [key]() {
+      sim::pressKey(key);
+      keyPresses++;
+    });
+  }
+  return ms - KEY_INTERVAL;
+}
+
+static byte randomZones() {
+  byte mask = _BV(randomBetween(0, ZONE_COUNT - 1));
+  if (chance(20)) {
+    mask |= _BV(randomBetween(0, ZONE_COUNT - 1));
+  }
+  return mask;
+}
+
+// Visits. Each schedules its inputs from the given time and returns the time
+// it's over, with the alarm armed & the gate closed.
+
+// Suspends the alarm, opens the gate & closes it again, then resets the alarm,
+// usually before the suspension is over, else once the alarm has sounded
+static uint64_t ownerVisit(uint64_t ms) {
+  unsigned int minutes = randomBetween(1, 30);
+  ms = keysAt(ms, std::to_string(minutes) + "#");
+  uint64_t timeout = ms + minutes * MILLIS_PER_MINUTE;
+  byte zones = randomZones();
+  ms = zonesAt(ms + randomBetween(5, 60) * MILLIS_PER_SECOND, 0, zones);
+  ms = zonesAt(ms + randomBetween(10, 300) * MILLIS_PER_SECOND, zones, 0);
+  if (chance(80)) {
+    ms = keysAt(ms + randomBetween(1, 60) * MILLIS_PER_SECOND, "*");
+  }
+  else {
+    ms = keysAt(max(ms, timeout) + randomBetween(30, 600) * MILLIS_PER_SECOND, "*");
+  }
+  return max(ms, timeout) + MILLIS_PER_MINUTE;
+}
+
+// Opens the gate without warning, so the alarm sounds until someone resets it
+static uint64_t unannouncedVisit(uint64_t ms) {
+  byte zones = randomZones();
+  ms = zonesAt(ms, 0, zones);
+  ms = zonesAt(ms + randomBetween(5, 120) * MILLIS_PER_SECOND, zones, 0);
+  return keysAt(ms + randomBetween(5, 900) * MILLIS_PER_SECOND, "*") + MILLIS_PER_MINUTE;
+}
+
+// Suspends the alarm indefinitely while the gate is opened a few times, then
+// resumes & resets it
+static uint64_t indefiniteVisit(uint64_t ms) {
+  ms = keysAt(ms, "#");
+  for (byte openings = randomBetween(1, 4); openings > 0; openings--) {
+    byte zones = randomZones();
+    ms = zonesAt(ms + randomBetween(1, 45) * MILLIS_PER_MINUTE, 0, zones);
+    ms = zonesAt(ms + randomBetween(10, 600) * MILLIS_PER_SECOND, zones, 0);
+  }
+  return keysAt(ms + randomBetween(10, 600) * MILLIS_PER_SECOND, "0#*") + MILLIS_PER_MINUTE;
+}
+
+// Enters a few random digits, sometimes too many, then # and later resumes
+static uint64_t fumbleVisit(uint64_t ms) {
+  std::string keys;
+  for (byte digits = randomBetween(1, 6); digits > 0; digits--) {
+    keys += (char) ('0' + randomBetween(0, 9));
+  }
+  ms = keysAt(ms, keys + "#");
+  return keysAt(ms + randomBetween(10, 300) * MILLIS_PER_SECOND, "0#*") + MILLIS_PER_MINUTE;
+}
+
+static void scheduleDay(unsigned long day) {
+  uint64_t dayStart = day * MILLIS_PER_DAY;
+
+  unsigned int mV = randomBetween(4700, 5100);
+  inputAt(dayStart + 6 * MILLIS_PER_HOUR, [mV]() { sim::setSupplyVoltage(mV); });
+  if (chance(3)) {
+    uint64_t sag = dayStart + randomBetween(0, 23) * MILLIS_PER_HOUR;
+    unsigned int low = randomBetween(4100, 4290);
+    inputAt(sag, [low]() { sim::setSupplyVoltage(low); });
+    inputAt(sag + randomBetween(1, 6) * MILLIS_PER_HOUR, [mV]() { sim::setSupplyVoltage(mV); });
+  }
+
+  uint64_t ms = dayStart + FIRST_VISIT_HOUR * MILLIS_PER_HOUR;
+  uint64_t last = dayStart + LAST_VISIT_HOUR * MILLIS_PER_HOUR;
+  while (true) {
+    ms += randomBetween(0, 4 * 60) * MILLIS_PER_MINUTE;
+    if (ms > last) {
+      break;
+    }
+    unsigned int kind = randomBetween(0, 99);
+    ms = kind < 50 ? ownerVisit(ms) : kind < 75 ? unannouncedVisit(ms) : kind < 85 ? indefiniteVisit(ms) : fumbleVisit(ms);
+    visits++;
+  }
+}
+
+// Checks
+
+// Called when a pulsed output goes high, with the pattern it should be showing
+static void checkCycle(PulseCycles &cycles, uint64_t now, unsigned long period, byte pulses) {
+  if (period != cycles.period || pulses != cycles.pulses || alarmFsm.state() != cycles.state) {
+    cycles.period = period;
+    cycles.pulses = pulses;
+    cycles.state = alarmFsm.state();
+    cycles.riseCount = 0;
+  }
+  memmove(cycles.rises + 1, cycles.rises, MAX_PULSES * sizeof(cycles.rises[0]));
+  cycles.rises[0] = now;
+  if (cycles.riseCount <= pulses) {
+    cycles.riseCount++;
+  }
+  uint64_t start = cycles.rises[pulses];
+  // An input may restart the pattern part way through
+  if (cycles.riseCount > pulses && lastInputAt + INPUT_SETTLE_TIME < start) {
+    long error = (long) (now - start) - (long) period;
+    cycles.checked++;
+    if (labs(error) > PULSE_TOLERANCE) {
+      char message[80];
+      snprintf(message, sizeof(message), "%s cycle took %lu ms, not %lu ms",
+        cycles.name, (unsigned long) (now - start), period);
+      fail(message);
+    }
+  }
+}
+
+static void onPinChange(uint8_t pin, uint8_t level) {
+  uint64_t now = sim::nowMillis();
+  if (pin == ALARM_BUZZER_PIN) {
+    lastBuzzerChange = now;
+    if (level == HIGH) {
+      if (alarmFsm.isAlarmSounding()) {
+        checkCycle(buzzerCycles, now, BUZZER_PERIOD, 1);
+      }
+      else {
+        buzzerCycles.riseCount = 0;
+      }
+    }
+  }
+  else if (pin == HEARTBEAT_LED_PIN && level == HIGH) {
+    if (isBatteryLow) {
+      checkCycle(heartbeatCycles, now, LOW_BATTERY_PERIOD, LOW_BATTERY_FLASHES);
+    }
+    else {
+      checkCycle(heartbeatCycles, now, HEARTBEAT_PERIOD, 1);
+    }
+  }
+}
+
+static void checkLoop() {
+  uint64_t now = sim::nowMillis();
+  if (now - lastLoopAt > maxLoopGap) {
+    maxLoopGap = now - lastLoopAt;
+    if (maxLoopGap > MAX_LOOP_GAP) {
+      fail("loop not run for too long");
+    }
+  }
+  lastLoopAt = now;
+  if (++dailyLoops > MAX_DAILY_LOOPS) {
+    fail("loop not sleeping");
+    exit(1);
+  }
+
+  if (alarmFsm.isSuspended() && !alarmFsm.isSuspendedForever() && suspendMillisLeft() == 0) {
+    if (!isDue) {
+      isDue = true;
+      dueSince = now;
+    }
+    else if (now > dueSince + TIMEOUT_SLACK) {
+      fail("suspension not timed out when due");
+      isDue = false;
+    }
+  }
+  else {
+    isDue = false;
+  }
+
+  if (alarmFsm.isAlarmSounding() && now > lastBuzzerChange + BUZZER_MAX_STEP) {
+    fail("buzzer not pulsing while alarm sounds");
+    lastBuzzerChange = now;
+  }
+}
+
+static void checkDay() {
+  uint64_t now = sim::nowMillis();
+  dailyLoops = 0;
+  if (alarmFsm.state() != STATE_ARMED || openedZones != 0 || suspendEntry.isEntering()) {
+    fail("alarm not armed with gate closed after day's visits");
+  }
+  if (sim::pinLevel(ALARM_BUZZER_PIN) != LOW) {
+    fail("buzzer on after day's visits");
+  }
+  if (now - heartbeatCycles.rises[0] > heartbeatCycles.period) {
+    fail("heartbeat LED not flashing");
+  }
+}
+
+static void printStats(unsigned long days) {
+  printf(
+    "day %5lu: %9lu loop passes, max loop gap %lu ms\n",
+    days, sim::loopCount(), (unsigned long) maxLoopGap
+  );
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long years = 1;
+  unsigned long seed = 1;
+  boolean verbose = false;
+  for (int arg = 1; arg < argc; arg++) {
+    if (strcmp(argv[arg], "-y") == 0 && arg + 1 < argc) {
+      years = strtoul(argv[++arg], NULL, 10);
+    }
+    else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+      seed = strtoul(argv[++arg], NULL, 0);
+    }
+    else if (strcmp(argv[arg], "-v") == 0) {
+      verbose = true;
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-y years] [-s seed] [-v]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (years < 1 || years > MAX_YEARS) {
+    fprintf(stderr, "Years must be from 1 to %d\n", MAX_YEARS);
+    return 2;
+  }
+  randomState = seed ? seed : 1;
+  unsigned long days = years * 365;
+
+  clock_t started = clock();
+  sim::setSerialOutput(NULL);
+  sim::onPinChange(onPinChange);
+  sim::onLoop(checkLoop);
+  sim::begin();
+  for (unsigned long day = 0; day < days; day++) {
+    scheduleDay(day);
+    sim::runUntil((day + 1) * MILLIS_PER_DAY + CHECK_HOUR * MILLIS_PER_HOUR);
+    checkDay();
+    if (verbose && (day + 1) % REPORT_INTERVAL == 0) {
+      printStats(day + 1);
+    }
+  }
+  double seconds = (double) (clock() - started) / CLOCKS_PER_SEC;
+
+  printStats(days);
+  printf(
+    "%lu visits, %lu key presses, %lu zone changes, millis() rolled over %lu times\n",
+    visits, keyPresses, zoneChanges, (unsigned long) (sim::nowMillis() >> 32)
+  );
+  printf(
+    "%lu heartbeat & %lu buzzer cycles checked\n",
+    heartbeatCycles.checked, buzzerCycles.checked
+  );
+  printf("%lu failures, %.0f days simulated in %.1f s\n", failures, sim::nowMillis() / (double) MILLIS_PER_DAY, seconds);
+  return failures > 0 ? 1 : 0;
+}